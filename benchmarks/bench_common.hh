@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Small helpers shared by the benchmark programs: wall clock timing,
+// sample statistics and a flat JSON result writer.
+
+inline double benchNowUs()
+{
+    return std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct BenchStats {
+    size_t count = 0;
+    double mean = 0, min = 0, p50 = 0, p90 = 0, p99 = 0, max = 0;
+
+    static BenchStats from(std::vector<double> samples)
+    {
+        BenchStats s;
+        if (samples.empty()) {
+            return s;
+        }
+        std::sort(samples.begin(), samples.end());
+        s.count = samples.size();
+        double sum = 0;
+        for (double v : samples) {
+            sum += v;
+        }
+        s.mean = sum / samples.size();
+        s.min = samples.front();
+        s.max = samples.back();
+        s.p50 = samples[(samples.size() - 1) * 50 / 100];
+        s.p90 = samples[(samples.size() - 1) * 90 / 100];
+        s.p99 = samples[(samples.size() - 1) * 99 / 100];
+        return s;
+    }
+};
+
+// Runs fn() `iterations` times after `warmup` untimed runs, one sample per run (microseconds).
+template <typename Fn>
+BenchStats benchRun(int warmup, int iterations, Fn fn)
+{
+    for (int i = 0; i < warmup; ++i) {
+        fn();
+    }
+    std::vector<double> samples;
+    samples.reserve(iterations);
+    for (int i = 0; i < iterations; ++i) {
+        double t0 = benchNowUs();
+        fn();
+        samples.push_back(benchNowUs() - t0);
+    }
+    return BenchStats::from(samples);
+}
+
+// Collects named results and writes them as {"name": ..., "results": [ {...}, ... ]}.
+class BenchReport {
+public:
+    explicit BenchReport(const std::string &name) : name_(name) {}
+
+    void add(const std::string &case_name, const BenchStats &s, const std::string &unit = "us",
+             const std::string &extra_json = "")
+    {
+        char buf[512];
+        snprintf(buf, sizeof(buf),
+                 "{\"case\":\"%s\",\"unit\":\"%s\",\"count\":%zu,\"mean\":%.3f,\"min\":%.3f,"
+                 "\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f%s%s}",
+                 case_name.c_str(), unit.c_str(), s.count, s.mean, s.min, s.p50, s.p90, s.p99, s.max,
+                 extra_json.empty() ? "" : ",", extra_json.c_str());
+        entries_.push_back(buf);
+        fprintf(stderr, "%-40s mean %10.3f %s  p50 %10.3f  p99 %10.3f\n",
+                case_name.c_str(), s.mean, unit.c_str(), s.p50, s.p99);
+    }
+
+    // Extra top level string field, e.g. library versions of the build.
+    void addMeta(const std::string &key, const std::string &value)
+    {
+        meta_ += ",\"" + key + "\":\"" + value + "\"";
+    }
+
+    bool write(const std::string &path) const
+    {
+        FILE *fp = path.empty() ? stdout : fopen(path.c_str(), "w");
+        if (!fp) {
+            return false;
+        }
+        fprintf(fp, "{\"benchmark\":\"%s\",\"arch\":\"%s\"%s,\"results\":[\n", name_.c_str(), arch(), meta_.c_str());
+        for (size_t i = 0; i < entries_.size(); ++i) {
+            fprintf(fp, "  %s%s\n", entries_[i].c_str(), i + 1 < entries_.size() ? "," : "");
+        }
+        fprintf(fp, "]}\n");
+        if (fp != stdout) {
+            fclose(fp);
+        }
+        return true;
+    }
+
+    static const char *arch()
+    {
+#if defined(__aarch64__)
+        return "arm64";
+#elif defined(__x86_64__)
+        return "amd64";
+#else
+        return "unknown";
+#endif
+    }
+
+private:
+    std::string name_;
+    std::string meta_;
+    std::vector<std::string> entries_;
+};
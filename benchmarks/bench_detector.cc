@@ -0,0 +1,155 @@
+// ObjectDetector per frame cost and heap allocations.
+//
+// usage: bench_detector cfg weights data [-o result.json] [-i image] [-n iterations]
+//
+// reused   detect(img, objects) with a persistent objects vector, the
+//          steady state must not allocate
+// vector   the detect(img) wrapper returning a new vector every frame
+// Allocations are counted by interposing malloc() and friends (glibc), which
+// covers operator new, OpenCV and darknet. Exits with 1 if the reused case
+// allocated, so it doubles as a check. Needs darknet (DARKNET_PATH).
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "bench_common.hh"
+#include "object_detector.hh"
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+}
+
+static std::atomic<uint64_t> g_allocations(0);
+
+extern "C" {
+void *malloc(size_t size) noexcept
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) noexcept
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) noexcept
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) noexcept
+{
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) noexcept
+{
+    void *p = memalign(alignment, size);
+    if (p == nullptr) {
+        return ENOMEM;
+    }
+    *ptr = p;
+    return 0;
+}
+}
+
+// Times fn() like benchRun() and counts the allocations of the timed runs.
+template <typename Fn>
+BenchStats benchCounted(int warmup, int iterations, Fn fn, uint64_t &allocations)
+{
+    for (int i = 0; i < warmup; ++i) {
+        fn();
+    }
+    std::vector<double> samples(iterations);
+    allocations = 0;
+    for (int i = 0; i < iterations; ++i) {
+        uint64_t before = g_allocations.load();
+        double t0 = benchNowUs();
+        fn();
+        samples[i] = benchNowUs() - t0;
+        allocations += g_allocations.load() - before;
+    }
+    return BenchStats::from(samples);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s cfg weights data [-o result.json] [-i image] [-n iterations]\n", argv[0]);
+        return 1;
+    }
+    std::string output = "bench_detector.json";
+    std::string input;
+    int iterations = 50;
+    for (int i = 4; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-o")) {
+            output = argv[i + 1];
+        } else if (!strcmp(argv[i], "-i")) {
+            input = argv[i + 1];
+        } else if (!strcmp(argv[i], "-n")) {
+            iterations = std::atoi(argv[i + 1]);
+        }
+    }
+    const int warmup = 5;
+
+    cv::Mat img;
+    if (!input.empty()) {
+        img = cv::imread(input, cv::IMREAD_COLOR);
+        if (img.empty()) {
+            fprintf(stderr, "can not read %s\n", input.c_str());
+            return 1;
+        }
+    } else {
+        img.create(730, 730, CV_8UC3);
+        cv::RNG rng(1234);
+        rng.fill(img, cv::RNG::UNIFORM, 0, 255);
+        cv::GaussianBlur(img, img, cv::Size(7, 7), 2.0);
+    }
+
+    ObjectDetector detector(argv[1], argv[2], argv[3]);
+    BenchReport report("detector");
+    report.addMeta("cfg", argv[1]);
+    report.addMeta("input", input.empty() ? "synthetic" : input);
+
+    std::vector<DetectedObject> objects;
+    uint64_t reusedAllocs = 0;
+    BenchStats reused = benchCounted(warmup, iterations, [&] { detector.detect(img, objects); }, reusedAllocs);
+    size_t found = objects.size();
+
+    uint64_t vectorAllocs = 0;
+    BenchStats fresh = benchCounted(warmup, iterations, [&] { objects = detector.detect(img); }, vectorAllocs);
+
+    char extra[96];
+    snprintf(extra, sizeof(extra), "\"objects\":%zu,\"allocations_per_frame\":%.2f", found,
+             (double)reusedAllocs / iterations);
+    report.add("reused", reused, "us", extra);
+    snprintf(extra, sizeof(extra), "\"objects\":%zu,\"allocations_per_frame\":%.2f", objects.size(),
+             (double)vectorAllocs / iterations);
+    report.add("vector", fresh, "us", extra);
+
+    bool written = report.write(output);
+    if (reusedAllocs > 0) {
+        fprintf(stderr, "steady state allocated %llu times in %d frames\n", (unsigned long long)reusedAllocs,
+                iterations);
+        return 1;
+    }
+    return written ? 0 : 1;
+}
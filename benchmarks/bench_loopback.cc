@@ -0,0 +1,198 @@
+// End-to-end loopback latency of image_server and a receiver over tcp://127.0.0.1.
+//
+// usage: bench_loopback [-s path/to/image_server] [-o result.json] [-d seconds] [-p port]
+//                       [-r replay_file]
+//
+// For every resolution and JPEG quality an image_server is started against the
+// synthetic (or replay) camera, then a REQ client measures:
+//   rtt_empty   header only request, the bare REQ/REP round trip
+//   encode      server side crop + JPEG encode (from the frame header)
+//   transfer    request round trip minus server time (network stack + copies)
+//   decode      client side JpegDecoder into a reused image
+//   latency     capture time stamp -> decoded image ready for display
+// plus the sustained fps of the request loop. Decoding at 1/2 and 1/4 size is
+// measured afterwards on the last received image, outside the timed loop.
+// Replies have a 5 s timeout: if the server dies the benchmark fails.
+
+#include <opencv2/opencv.hpp>
+#include <zmq.hpp>
+#include <csignal>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "bench_common.hh"
+#include "frame_protocol.hh"
+#include "jpeg_decoder.hh"
+
+static pid_t startServer(const std::string &server, const std::vector<std::string> &args)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        std::vector<char *> argv;
+        argv.push_back(const_cast<char *>(server.c_str()));
+        for (const std::string &a : args) {
+            argv.push_back(const_cast<char *>(a.c_str()));
+        }
+        argv.push_back(nullptr);
+        if (!freopen("/dev/null", "w", stdout)) {
+            _exit(127);
+        }
+        execv(server.c_str(), argv.data());
+        perror("execv");
+        _exit(127);
+    }
+    return pid;
+}
+
+static void stopServer(pid_t pid)
+{
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+}
+
+// Receives one message; false on timeout (the server hung or died).
+static bool recvReply(zmq::socket_t &socket, zmq::message_t &msg)
+{
+    if (!socket.recv(msg)) {
+        fprintf(stderr, "no reply from image_server within the timeout\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string self = argv[0];
+    std::string server = self.substr(0, self.find_last_of('/') + 1) + "image_server";
+    std::string output = "bench_loopback.json";
+    std::string replay;
+    double seconds = 5;
+    int port = 25761;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-s")) {
+            server = argv[i + 1];
+        } else if (!strcmp(argv[i], "-o")) {
+            output = argv[i + 1];
+        } else if (!strcmp(argv[i], "-d")) {
+            seconds = atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "-p")) {
+            port = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "-r")) {
+            replay = argv[i + 1];
+        }
+    }
+
+    BenchReport report("loopback");
+    report.addMeta("camera", replay.empty() ? "synthetic" : replay);
+    const cv::Size sizes[] = {cv::Size(1856, 800), cv::Size(928, 400)};
+    const int qualities[] = {50, 75, 92};
+
+    zmq::context_t context(1);
+    for (const cv::Size &size : sizes) {
+        std::vector<std::string> args = {"--port", std::to_string(port)};
+        if (replay.empty()) {
+            args.push_back("--synthetic");
+        } else {
+            args.push_back("--replay");
+            args.push_back(replay);
+        }
+        args.push_back("0");
+        args.push_back(std::to_string(size.width));
+        args.push_back(std::to_string(size.height));
+        args.push_back("30");
+        pid_t pid = startServer(server, args);
+
+        zmq::socket_t socket(context, ZMQ_REQ);
+        socket.set(zmq::sockopt::linger, 0);
+        socket.set(zmq::sockopt::rcvtimeo, 5000);
+        socket.connect("tcp://127.0.0.1:" + std::to_string(port));
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));  // camera start up
+
+        std::string tag = "_" + std::to_string(size.width) + "x" + std::to_string(size.height);
+
+        // bare round trip: header only request and reply
+        FrameRequest probe;
+        probe.parts = FRAME_PART_NONE;
+        std::vector<double> rtt;
+        for (int i = 0; i < 500; ++i) {
+            double t0 = benchNowUs();
+            socket.send(zmq::buffer(&probe, sizeof(probe)));
+            zmq::message_t msg;
+            if (!recvReply(socket, msg)) {
+                stopServer(pid);
+                return 1;
+            }
+            rtt.push_back(benchNowUs() - t0);
+        }
+        report.add("rtt_empty" + tag, BenchStats::from(rtt));
+
+        for (int quality : qualities) {
+            FrameRequest req;
+            req.quality = (uint8_t)quality;
+            std::vector<double> encode, transfer, decode, latency;
+            JpegDecoder decoder;
+            cv::Mat img, half, quarter;
+            zmq::message_t last;  // last decodable image, for the scaled decode pass
+            uint64_t lastSeq = 0, frames = 0, bytes = 0;
+            double start = benchNowUs();
+            while (benchNowUs() - start < seconds * 1e6) {
+                double t0 = benchNowUs();
+                socket.send(zmq::buffer(&req, sizeof(req)));
+                zmq::message_t head, jpeg;
+                if (!recvReply(socket, head)) {
+                    stopServer(pid);
+                    return 1;
+                }
+                FrameHeader hdr;
+                if (!parseFrameHeader(head, hdr) || !head.more()) {
+                    fprintf(stderr, "unexpected reply\n");
+                    stopServer(pid);
+                    return 1;
+                }
+                if (!recvReply(socket, jpeg)) {
+                    stopServer(pid);
+                    return 1;
+                }
+                double roundTrip = benchNowUs() - t0;
+
+                const uint8_t *data = static_cast<const uint8_t *>(jpeg.data());
+                double d0 = benchNowUs();
+                bool decoded = decoder.decode(data, jpeg.size(), img);
+                decode.push_back(benchNowUs() - d0);
+                if (!decoded) {
+                    continue;
+                }
+                latency.push_back((double)(wallClockUs() - hdr.capture_us));
+                encode.push_back(hdr.encode_us);
+                transfer.push_back(roundTrip - hdr.server_us);
+                bytes += jpeg.size();
+                if (hdr.seq != lastSeq) {
+                    frames++;
+                    lastSeq = hdr.seq;
+                }
+                last = std::move(jpeg);
+            }
+            double elapsed = (benchNowUs() - start) / 1e6;
+            std::string q = tag + "_q" + std::to_string(quality);
+            char extra[128];
+            snprintf(extra, sizeof(extra), "\"fps\":%.2f,\"replies_per_s\":%.2f,\"avg_bytes\":%.0f",
+                     frames / elapsed, latency.size() / elapsed, latency.empty() ? 0.0 : (double)bytes / latency.size());
+            report.add("latency" + q, BenchStats::from(latency), "us", extra);
+            report.add("encode" + q, BenchStats::from(encode));
+            report.add("transfer" + q, BenchStats::from(transfer));
+            report.add("decode" + q, BenchStats::from(decode));
+            if (last.size() > 0) {
+                const uint8_t *data = static_cast<const uint8_t *>(last.data());
+                int runs = (int)std::min<size_t>(std::max<size_t>(decode.size(), 1), 200);
+                report.add("decode_half" + q, benchRun(2, runs, [&]() { decoder.decode(data, last.size(), half, 2); }));
+                report.add("decode_quarter" + q, benchRun(2, runs, [&]() { decoder.decode(data, last.size(), quarter, 4); }));
+            }
+        }
+        stopServer(pid);
+    }
+
+    return report.write(output) ? 0 : 1;
+}
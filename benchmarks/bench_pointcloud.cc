@@ -0,0 +1,147 @@
+// Size and speed of PointCloudCodec on organized and unorganized clouds.
+//
+// usage: bench_pointcloud [-o result.json] [-i depth_mm.png] [-n iterations]
+//
+// Clouds are back projected from a depth image (90 degree pinhole): a synthetic
+// scene (tilted plane with ripples and a box) or a recorded 16 bit depth image
+// in millimetres. Points without depth are dropped from the unorganized clouds,
+// like StereoCamera::getPointCloud does. The ratio is against the in-memory
+// size of std::vector<cv::Vec3f> / std::vector<PCLType>.
+
+#include <PointCloudCodec.hpp>
+#include <opencv2/opencv.hpp>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "bench_common.hh"
+
+static cv::Mat makeDepth(const cv::Size &size, const std::string &recorded)
+{
+    cv::Mat depth;
+    if (!recorded.empty()) {
+        cv::Mat img = cv::imread(recorded, cv::IMREAD_UNCHANGED);
+        if (img.empty() || img.type() != CV_16U) {
+            fprintf(stderr, "can not read 16 bit depth image %s\n", recorded.c_str());
+            exit(EXIT_FAILURE);
+        }
+        cv::resize(img, depth, size, 0, 0, cv::INTER_NEAREST);
+        return depth;
+    }
+    depth.create(size, CV_16U);
+    cv::RNG rng(1234);
+    for (int y = 0; y < size.height; ++y) {
+        for (int x = 0; x < size.width; ++x) {
+            double z = 800 + 1500.0 * y / size.height + 60 * std::sin(x / 23.0) + rng.gaussian(2.0);
+            if (x > size.width / 3 && x < size.width / 2 && y > size.height / 3 && y < size.height * 2 / 3) {
+                z = 600 + rng.gaussian(2.0);  // box in front of the plane
+            }
+            if (rng.uniform(0, 100) < 3) {
+                z = 0;  // no disparity
+            }
+            depth.at<uint16_t>(y, x) = cv::saturate_cast<uint16_t>(z);
+        }
+    }
+    return depth;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string output = "bench_pointcloud.json";
+    std::string recorded;
+    int iterations = 50;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-o")) {
+            output = argv[i + 1];
+        } else if (!strcmp(argv[i], "-i")) {
+            recorded = argv[i + 1];
+        } else if (!strcmp(argv[i], "-n")) {
+            iterations = std::atoi(argv[i + 1]);
+        }
+    }
+    const int warmup = 5;
+
+    BenchReport report("pointcloud");
+    report.addMeta("opencv", CV_VERSION);
+    report.addMeta("input", recorded.empty() ? "synthetic" : recorded);
+#ifdef HAVE_ZSTD
+    const int levels[] = {0, 1, 3};
+#else
+    const int levels[] = {0};
+#endif
+    const float precisions[] = {0.0005f, 0.001f, 0.0025f};
+    const cv::Size sizes[] = {cv::Size(464, 400), cv::Size(928, 800)};
+    for (const cv::Size &size : sizes) {
+        cv::Mat depth = makeDepth(size, recorded);
+        cv::Mat color(size, CV_8UC3);
+        cv::randu(color, cv::Scalar::all(0), cv::Scalar::all(255));
+        cv::GaussianBlur(color, color, cv::Size(9, 9), 3.0);
+
+        // organized: one point per pixel, unorganized: valid pixels only
+        std::vector<cv::Vec3f> organized, unorganized;
+        std::vector<PCLType> colored;
+        float f = size.width / 2.0f, cx = size.width / 2.0f, cy = size.height / 2.0f;
+        for (int y = 0; y < size.height; ++y) {
+            for (int x = 0; x < size.width; ++x) {
+                float z = depth.at<uint16_t>(y, x) * 0.001f;
+                cv::Vec3f p((x - cx) * z / f, (y - cy) * z / f, z);
+                organized.push_back(p);
+                if (z > 0) {
+                    unorganized.push_back(p);
+                    PCLType pt;
+                    pt.pts = p;
+                    pt.clr = color.at<cv::Vec3b>(y, x);
+                    colored.push_back(pt);
+                }
+            }
+        }
+
+        std::string tag = "_" + std::to_string(size.width) + "x" + std::to_string(size.height);
+        for (int level : levels) {
+            for (float precision : precisions) {
+                PointCloudCodec codec(precision);
+                codec.setCompressionLevel(level);
+                char name[64];
+                snprintf(name, sizeof(name), "_p%.1fmm_zstd%d", precision * 1000, level);
+
+                for (int organizedCloud = 0; organizedCloud < 2; ++organizedCloud) {
+                    const std::vector<cv::Vec3f> &pcl = organizedCloud ? organized : unorganized;
+                    uint32_t width = organizedCloud ? (uint32_t)size.width : 0;
+                    std::vector<uint8_t> data;
+                    std::vector<cv::Vec3f> decoded;
+                    BenchStats enc = benchRun(warmup, iterations, [&] { codec.encode(pcl, data, width); });
+                    BenchStats dec = benchRun(warmup, iterations, [&] { codec.decode(data.data(), data.size(), decoded); });
+                    float maxError = 0;
+                    for (size_t i = 0; i < pcl.size() && i < decoded.size(); ++i) {
+                        for (int k = 0; k < 3; ++k) {
+                            maxError = std::max(maxError, std::fabs(pcl[i][k] - decoded[i][k]));
+                        }
+                    }
+                    double ratio = pcl.size() * sizeof(cv::Vec3f) / (double)data.size();
+                    char extra[160];
+                    snprintf(extra, sizeof(extra), "\"points\":%zu,\"bytes\":%zu,\"ratio\":%.2f,\"max_error_m\":%.6f",
+                             pcl.size(), data.size(), ratio, maxError);
+                    std::string cloud = organizedCloud ? "organized" : "unorganized";
+                    report.add("encode_" + cloud + tag + name, enc, "us", extra);
+                    report.add("decode_" + cloud + tag + name, dec, "us", extra);
+                }
+            }
+
+            PointCloudCodec codec;
+            codec.setCompressionLevel(level);
+            std::vector<uint8_t> data;
+            std::vector<PCLType> decoded;
+            BenchStats enc = benchRun(warmup, iterations, [&] { codec.encode(colored, data); });
+            BenchStats dec = benchRun(warmup, iterations, [&] { codec.decode(data.data(), data.size(), decoded); });
+            char extra[128];
+            snprintf(extra, sizeof(extra), "\"points\":%zu,\"bytes\":%zu,\"ratio\":%.2f", colored.size(), data.size(),
+                     colored.size() * sizeof(PCLType) / (double)data.size());
+            std::string name = "_color" + tag + "_zstd" + std::to_string(level);
+            report.add("encode" + name, enc, "us", extra);
+            report.add("decode" + name, dec, "us", extra);
+        }
+    }
+
+    return report.write(output) ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+// ObjectDetector input preprocessing: the former three pass path against the
+// fused LetterboxPreprocessor.
+//
+// usage: bench_preprocess [-o result.json] [-i image] [-n iterations]
+//
+// legacy  cv::cvtColor(BGR2RGB), per pixel conversion to planar floats with a
+//         divide, darknet's letterbox_image() (resize_image() + embed), with
+//         the allocations of every frame
+// fused   LetterboxPreprocessor::run() into a persistent input buffer
+// for the receiver ROI (730x730) and the half raw frame (928x800) at the
+// common network sizes. Darknet's image functions are reproduced here so the
+// benchmark does not need darknet; max_diff is against that reference.
+
+#include <opencv2/opencv.hpp>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "bench_common.hh"
+#include "letterbox.hh"
+
+namespace legacy {
+
+struct image {
+    int w, h, c;
+    float *data;
+};
+
+static image make_image(int w, int h, int c)
+{
+    image im = {w, h, c, (float *)calloc((size_t)w * h * c, sizeof(float))};
+    return im;
+}
+
+static void free_image(image m) { free(m.data); }
+static float get_pixel(image m, int x, int y, int c) { return m.data[c * m.h * m.w + y * m.w + x]; }
+static void set_pixel(image m, int x, int y, int c, float v) { m.data[c * m.h * m.w + y * m.w + x] = v; }
+static void add_pixel(image m, int x, int y, int c, float v) { m.data[c * m.h * m.w + y * m.w + x] += v; }
+
+// ObjectDetector::mat_to_image()
+static image mat_to_image(const cv::Mat &mat)
+{
+    int w = mat.cols, h = mat.rows, c = mat.channels();
+    image im = make_image(w, h, c);
+    unsigned char *data = (unsigned char *)mat.data;
+    int step = (int)mat.step;
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            for (int k = 0; k < c; ++k) {
+                im.data[k * w * h + y * w + x] = data[y * step + x * c + k] / 255.0;
+            }
+        }
+    }
+    return im;
+}
+
+static image resize_image(image im, int w, int h)
+{
+    image resized = make_image(w, h, im.c);
+    if (im.w == w && im.h == h) {
+        memcpy(resized.data, im.data, (size_t)w * h * im.c * sizeof(float));
+        return resized;
+    }
+    image part = make_image(w, im.h, im.c);
+    float w_scale = (float)(im.w - 1) / (w - 1);
+    float h_scale = (float)(im.h - 1) / (h - 1);
+    for (int k = 0; k < im.c; ++k) {
+        for (int r = 0; r < im.h; ++r) {
+            for (int c = 0; c < w; ++c) {
+                float val = 0;
+                if (c == w - 1 || im.w == 1) {
+                    val = get_pixel(im, im.w - 1, r, k);
+                } else {
+                    float sx = c * w_scale;
+                    int ix = (int)sx;
+                    float dx = sx - ix;
+                    val = (1 - dx) * get_pixel(im, ix, r, k) + dx * get_pixel(im, ix + 1, r, k);
+                }
+                set_pixel(part, c, r, k, val);
+            }
+        }
+    }
+    for (int k = 0; k < im.c; ++k) {
+        for (int r = 0; r < h; ++r) {
+            float sy = r * h_scale;
+            int iy = (int)sy;
+            float dy = sy - iy;
+            for (int c = 0; c < w; ++c) {
+                set_pixel(resized, c, r, k, (1 - dy) * get_pixel(part, c, iy, k));
+            }
+            if (r == h - 1 || im.h == 1) {
+                continue;
+            }
+            for (int c = 0; c < w; ++c) {
+                add_pixel(resized, c, r, k, dy * get_pixel(part, c, iy + 1, k));
+            }
+        }
+    }
+    free_image(part);
+    return resized;
+}
+
+static image letterbox_image(image im, int w, int h)
+{
+    int new_w = im.w, new_h = im.h;
+    if (((float)w / im.w) < ((float)h / im.h)) {
+        new_w = w;
+        new_h = (im.h * w) / im.w;
+    } else {
+        new_h = h;
+        new_w = (im.w * h) / im.h;
+    }
+    image resized = resize_image(im, new_w, new_h);
+    image boxed = make_image(w, h, im.c);
+    std::fill(boxed.data, boxed.data + w * h * im.c, 0.5f);
+    int dx = (w - new_w) / 2, dy = (h - new_h) / 2;
+    for (int k = 0; k < im.c; ++k) {
+        for (int y = 0; y < new_h; ++y) {
+            for (int x = 0; x < new_w; ++x) {
+                set_pixel(boxed, x + dx, y + dy, k, get_pixel(resized, x, y, k));
+            }
+        }
+    }
+    free_image(resized);
+    return boxed;
+}
+
+}  // namespace legacy
+
+int main(int argc, char *argv[])
+{
+    std::string output = "bench_preprocess.json";
+    std::string input;
+    int iterations = 100;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-o")) {
+            output = argv[i + 1];
+        } else if (!strcmp(argv[i], "-i")) {
+            input = argv[i + 1];
+        } else if (!strcmp(argv[i], "-n")) {
+            iterations = std::atoi(argv[i + 1]);
+        }
+    }
+    const int warmup = 5;
+
+    cv::Mat source;
+    if (!input.empty()) {
+        source = cv::imread(input, cv::IMREAD_COLOR);
+        if (source.empty()) {
+            fprintf(stderr, "can not read %s\n", input.c_str());
+            return 1;
+        }
+    } else {
+        source.create(800, 928, CV_8UC3);
+        cv::RNG rng(1234);
+        rng.fill(source, cv::RNG::UNIFORM, 0, 255);
+        cv::GaussianBlur(source, source, cv::Size(7, 7), 2.0);
+    }
+
+    BenchReport report("preprocess");
+    report.addMeta("opencv", CV_VERSION);
+    report.addMeta("input", input.empty() ? "synthetic" : input);
+    const cv::Size sizes[] = {cv::Size(730, 730), cv::Size(928, 800)};
+    const int networks[] = {416, 608};
+    for (const cv::Size &size : sizes) {
+        cv::Mat img;
+        cv::resize(source, img, size, 0, 0, cv::INTER_AREA);
+        for (int net : networks) {
+            legacy::image reference = {0, 0, 0, nullptr};
+            BenchStats old = benchRun(warmup, iterations, [&] {
+                legacy::free_image(reference);
+                cv::Mat rgb;
+                cv::cvtColor(img, rgb, cv::COLOR_BGR2RGB);
+                legacy::image im = legacy::mat_to_image(rgb);
+                reference = legacy::letterbox_image(im, net, net);
+                legacy::free_image(im);
+            });
+
+            std::vector<float> tensor(net * net * 3);
+            LetterboxPreprocessor preprocessor;
+            BenchStats fused = benchRun(warmup, iterations, [&] { preprocessor.run(img, net, net, tensor.data()); });
+
+            float maxDiff = 0;
+            for (size_t i = 0; i < tensor.size(); ++i) {
+                maxDiff = std::max(maxDiff, std::fabs(tensor[i] - reference.data[i]));
+            }
+            legacy::free_image(reference);
+
+            std::string tag = "_" + std::to_string(size.width) + "x" + std::to_string(size.height) + "_net" +
+                              std::to_string(net);
+            char extra[96];
+            snprintf(extra, sizeof(extra), "\"speedup\":%.2f,\"max_diff\":%.2e", old.mean / fused.mean, maxDiff);
+            report.add("legacy" + tag, old);
+            report.add("fused" + tag, fused, "us", extra);
+        }
+    }
+
+    return report.write(output) ? 0 : 1;
+}
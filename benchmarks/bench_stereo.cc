@@ -0,0 +1,240 @@
+// Stereo pipeline benchmarks.
+//
+// usage: bench_stereo [-o result.json] [-i recorded_raw_frame.png] [-n iterations] [-c stereo_camera_config.yaml]
+//
+// The kernel cases ("remap", "disparity_*", "depth", "point_cloud", "colorize",
+// "jpeg_encode") are OpenCV reference implementations of the steps the SDK
+// performs, at both supported raw frame sizes: a baseline for the cost of
+// the work on this machine, not a measurement of libunitree_camera. Without
+// -i a synthetic textured scene is used, the right image is the left one
+// shifted by a smooth disparity ramp. A recorded raw stereo frame (right |
+// left, as returned by StereoCamera::getRawFrame) is resized to each frame size.
+//
+// With -c the SDK itself is measured on the camera the config file opens
+// (cases "sdk_*"): after startCapture() and startStereoCompute() each getter
+// is polled until it delivered `iterations` results. The time of the
+// successful calls is reported, with the number of empty polls and the rate
+// of delivered results.
+
+#include <StereoCameraCommon.hpp>
+#include <UnitreeCameraSDK.hpp>
+#include <opencv2/opencv.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench_common.hh"
+
+struct StereoScene {
+    cv::Mat raw;          // side by side raw frame, right | left like the camera
+    cv::Mat left, right;  // single frames (views into raw)
+};
+
+static StereoScene makeScene(const cv::Size &rawSize, const std::string &recorded)
+{
+    StereoScene scene;
+    if (!recorded.empty()) {
+        cv::Mat img = cv::imread(recorded, cv::IMREAD_COLOR);
+        if (img.empty()) {
+            fprintf(stderr, "can not read %s\n", recorded.c_str());
+            exit(EXIT_FAILURE);
+        }
+        cv::resize(img, scene.raw, rawSize, 0, 0, cv::INTER_AREA);
+    } else {
+        cv::Size single(rawSize.width / 2, rawSize.height);
+        cv::Mat texture(single, CV_8UC3);
+        cv::RNG rng(1234);
+        rng.fill(texture, cv::RNG::UNIFORM, 0, 255);
+        cv::GaussianBlur(texture, texture, cv::Size(5, 5), 1.2);
+
+        cv::Mat mapx(single, CV_32F), mapy(single, CV_32F);
+        for (int y = 0; y < single.height; ++y) {
+            for (int x = 0; x < single.width; ++x) {
+                mapx.at<float>(y, x) = x + 4.0f + 40.0f * y / single.height;
+                mapy.at<float>(y, x) = (float)y;
+            }
+        }
+        cv::Mat shifted;
+        cv::remap(texture, shifted, mapx, mapy, cv::INTER_LINEAR, cv::BORDER_REFLECT);
+        cv::hconcat(shifted, texture, scene.raw);
+    }
+    int half = rawSize.width / 2;
+    scene.right = scene.raw(cv::Rect(0, 0, half, rawSize.height));
+    scene.left = scene.raw(cv::Rect(half, 0, half, rawSize.height));
+    return scene;
+}
+
+// Polls get() (returns true when it delivered a new result) until `iterations`
+// results or timeout, timing the successful calls.
+template <typename Get>
+static void benchGetter(BenchReport &report, const std::string &name, int iterations, Get get)
+{
+    std::vector<double> samples;
+    samples.reserve(iterations);
+    uint64_t empty = 0;
+    double start = benchNowUs(), deadline = start + 30e6;
+    while ((int)samples.size() < iterations && benchNowUs() < deadline) {
+        double t0 = benchNowUs();
+        if (get()) {
+            samples.push_back(benchNowUs() - t0);
+        } else {
+            empty++;
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+    }
+    double elapsed = (benchNowUs() - start) / 1e6;
+    if (samples.empty()) {
+        fprintf(stderr, "%s: no result within 30 s\n", name.c_str());
+    }
+    char extra[128];
+    snprintf(extra, sizeof(extra), "\"empty_polls\":%llu,\"results_per_s\":%.2f", (unsigned long long)empty,
+             elapsed > 0 ? samples.size() / elapsed : 0.0);
+    report.add(name, BenchStats::from(samples), "us", extra);
+}
+
+// The SDK's own getters on a real camera.
+static bool benchSdk(BenchReport &report, const std::string &config, int iterations)
+{
+    UnitreeCamera cam(config);
+    if (!cam.isOpened()) {
+        fprintf(stderr, "can not open the camera of %s\n", config.c_str());
+        return false;
+    }
+    cam.startCapture();
+    cam.startStereoCompute();
+    std::this_thread::sleep_for(std::chrono::seconds(1));  // let capture and stereo computation settle
+
+    cv::Size raw = cam.getRawFrameSize();
+    std::string tag = "_" + std::to_string(raw.width) + "x" + std::to_string(raw.height);
+    cv::Mat frame, left, right, depth;
+    std::vector<cv::Vec3f> pcl;
+    std::chrono::microseconds t;
+    benchGetter(report, "sdk_raw_frame" + tag, iterations, [&]() { return cam.getRawFrame(frame, t); });
+    benchGetter(report, "sdk_rect_stereo_frame" + tag, iterations, [&]() { return cam.getRectStereoFrame(left, right); });
+    benchGetter(report, "sdk_depth_frame" + tag, iterations, [&]() { return cam.getDepthFrame(depth, false, t); });
+    benchGetter(report, "sdk_depth_frame_color" + tag, iterations, [&]() { return cam.getDepthFrame(depth, true, t); });
+    benchGetter(report, "sdk_point_cloud" + tag, iterations, [&]() { return cam.getPointCloud(pcl, t); });
+
+    cam.stopStereoCompute();
+    cam.stopCapture();
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string output = "bench_stereo.json";
+    std::string recorded;
+    std::string config;
+    int iterations = 50;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-o")) {
+            output = argv[i + 1];
+        } else if (!strcmp(argv[i], "-i")) {
+            recorded = argv[i + 1];
+        } else if (!strcmp(argv[i], "-n")) {
+            iterations = std::atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "-c")) {
+            config = argv[i + 1];
+        }
+    }
+    const int warmup = 5;
+
+    BenchReport report("stereo");
+    report.addMeta("opencv", CV_VERSION);
+    report.addMeta("input", recorded.empty() ? "synthetic" : recorded);
+    report.addMeta("camera", config.empty() ? "none" : config);
+    if (!config.empty() && !benchSdk(report, config, iterations)) {
+        return 1;
+    }
+    const cv::Size rawSizes[] = {cv::Size(1856, 800), cv::Size(928, 400)};
+    for (const cv::Size &rawSize : rawSizes) {
+        StereoScene scene = makeScene(rawSize, recorded);
+        cv::Size single(rawSize.width / 2, rawSize.height);
+        cv::Size rectSize(single.width / 2, single.height / 2);  // default rectify size of the SDK examples
+        std::string tag = "_" + std::to_string(rawSize.width) + "x" + std::to_string(rawSize.height);
+
+        // remap / rectification of both eyes with fixed point maps
+        double f = rectSize.width * 0.5;
+        cv::Mat K = (cv::Mat_<double>(3, 3) << single.width * 0.45, 0, single.width / 2.0,
+                     0, single.width * 0.45, single.height / 2.0, 0, 0, 1);
+        cv::Mat D = (cv::Mat_<double>(1, 5) << -0.28, 0.07, 0.0005, -0.0002, 0);
+        cv::Mat P = (cv::Mat_<double>(3, 3) << f, 0, rectSize.width / 2.0, 0, f, rectSize.height / 2.0, 0, 0, 1);
+        cv::Mat map1, map2;
+        cv::initUndistortRectifyMap(K, D, cv::Mat(), P, rectSize, CV_16SC2, map1, map2);
+        cv::Mat rectLeft, rectRight;
+        report.add("remap" + tag, benchRun(warmup, iterations, [&]() {
+            cv::remap(scene.left, rectLeft, map1, map2, cv::INTER_LINEAR);
+            cv::remap(scene.right, rectRight, map1, map2, cv::INTER_LINEAR);
+        }));
+
+        // disparity on the rectified pair, block matching and semi global matching
+        cv::Mat grayLeft, grayRight, disp16, disp;
+        cv::cvtColor(rectLeft, grayLeft, cv::COLOR_BGR2GRAY);
+        cv::cvtColor(rectRight, grayRight, cv::COLOR_BGR2GRAY);
+        cv::Ptr<cv::StereoBM> bm = cv::StereoBM::create(64, 9);
+        report.add("disparity_bm" + tag, benchRun(warmup, iterations, [&]() {
+            bm->compute(grayLeft, grayRight, disp16);
+        }));
+        cv::Ptr<cv::StereoSGBM> sgbm = cv::StereoSGBM::create(0, 64, 5, 8 * 25, 32 * 25, 1, 0, 10, 100, 2,
+                                                               cv::StereoSGBM::MODE_SGBM_3WAY);
+        report.add("disparity_sgbm" + tag, benchRun(warmup, iterations, [&]() {
+            sgbm->compute(grayLeft, grayRight, disp16);
+        }));
+        disp16.convertTo(disp, CV_32F, 1.0 / 16);
+
+        // depth = f * baseline / disparity, invalid disparities become 0
+        const float baseline = 0.025f;
+        cv::Mat depth(disp.size(), CV_32F);
+        report.add("depth" + tag, benchRun(warmup, iterations, [&]() {
+            const float fb = (float)f * baseline;
+            for (int y = 0; y < disp.rows; ++y) {
+                const float *d = disp.ptr<float>(y);
+                float *z = depth.ptr<float>(y);
+                for (int x = 0; x < disp.cols; ++x) {
+                    z[x] = d[x] > 0.5f ? fb / d[x] : 0.f;
+                }
+            }
+        }));
+
+        // colored point cloud of valid pixels in the depth range
+        std::vector<PCLType> pcl;
+        pcl.reserve(depth.total());
+        const float cx = rectSize.width / 2.0f, cy = rectSize.height / 2.0f, invf = 1.0f / (float)f;
+        BenchStats pclStats = benchRun(warmup, iterations, [&]() {
+            pcl.clear();
+            for (int y = 0; y < depth.rows; ++y) {
+                const float *z = depth.ptr<float>(y);
+                const cv::Vec3b *c = rectLeft.ptr<cv::Vec3b>(y);
+                for (int x = 0; x < depth.cols; ++x) {
+                    if (z[x] > 0.05f && z[x] < 1.0f) {
+                        PCLType p;
+                        p.pts = cv::Vec3f((x - cx) * z[x] * invf, (y - cy) * z[x] * invf, z[x]);
+                        p.clr = c[x];
+                        pcl.push_back(p);
+                    }
+                }
+            }
+        });
+        report.add("point_cloud" + tag, pclStats, "us", "\"points\":" + std::to_string(pcl.size()));
+
+        // depth colorization as getDepthFrame(depth, true, t)
+        cv::Mat depth8, colored;
+        report.add("colorize" + tag, benchRun(warmup, iterations, [&]() {
+            depth.convertTo(depth8, CV_8U, 255.0);
+            cv::applyColorMap(depth8, colored, cv::COLORMAP_JET);
+        }));
+
+        // JPEG encoding of the left half as image_server.cc does
+        std::vector<uint8_t> jpeg;
+        std::vector<int> param = {cv::IMWRITE_JPEG_QUALITY, 92};
+        BenchStats jpegStats = benchRun(warmup, iterations, [&]() {
+            cv::Mat left;
+            scene.raw(cv::Rect(rawSize.width / 2, 0, rawSize.width / 2, rawSize.height)).copyTo(left);
+            cv::imencode(".jpg", left, jpeg, param);
+        });
+        report.add("jpeg_encode" + tag, jpegStats, "us", "\"bytes\":" + std::to_string(jpeg.size()));
+    }
+
+    return report.write(output) ? 0 : 1;
+}
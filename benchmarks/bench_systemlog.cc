@@ -0,0 +1,95 @@
+// Producer side cost per log call of SystemLog (synchronous) and AsyncSystemLog.
+//
+// usage: bench_systemlog [output.json]
+// Console output of the loggers is redirected to /dev/null, so the synchronous
+// numbers are a lower bound of what a terminal or a slow disk costs.
+
+#include <SystemLog.hpp>
+#include <AsyncSystemLog.hpp>
+#include <SystemLogMacros.hpp>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "bench_common.hh"
+
+static const int kCallsPerSample = 256;
+static const int kSamples = 200;
+
+template <typename Fn>
+BenchStats perCallNs(Fn fn)
+{
+    std::vector<double> samples;
+    for (int s = 0; s < kSamples; ++s) {
+        double t0 = benchNowUs();
+        for (int i = 0; i < kCallsPerSample; ++i) {
+            fn(s * kCallsPerSample + i);
+        }
+        samples.push_back((benchNowUs() - t0) * 1000.0 / kCallsPerSample);
+    }
+    return BenchStats::from(samples);
+}
+
+int main(int argc, char *argv[])
+{
+    std::string output = argc >= 2 ? argv[1] : "bench_systemlog.json";
+    BenchReport report("systemlog");
+
+    int console = dup(STDOUT_FILENO);
+    if (!freopen("/dev/null", "w", stdout)) {
+        return 1;
+    }
+
+    SystemLog syncLog("BenchSync");
+    syncLog.setLogLevel(1);
+    report.add("sync_runTimeInfo", perCallNs([&](int i) {
+        syncLog.runTimeInfo("frame %d disparity %.3f ms\n", i, i * 0.001);
+    }), "ns");
+    report.add("sync_debugTimeInfo_filtered", perCallNs([&](int i) {
+        syncLog.debugTimeInfo("frame %d disparity %.3f ms\n", i, i * 0.001);
+    }), "ns");
+    report.add("macro_debugTimeInfo_module_filtered", perCallNs([&](int i) {
+        SYSLOG_DEBUG_INFO(syncLog, LOG_MODULE_APPLICATION, "frame %d disparity %.3f ms\n", i, i * 0.001);
+    }), "ns");
+
+    report.add("macro_runTimeWarning_rate_limited", perCallNs([&](int i) {
+        SYSLOG_RUNTIME_WARNING_LIMITED(syncLog, LOG_MODULE_APPLICATION, 1, 1, "camera glitch on frame %d\n", i);
+    }), "ns");
+
+    // big enough ring that the single thread case measures pushing, not dropping
+    AsyncLogBackend::instance().setRingCapacity(kCallsPerSample * kSamples);
+    AsyncSystemLog asyncLog("BenchAsync");
+    asyncLog.setLogLevel(1);
+    report.add("async_runTimeInfo", perCallNs([&](int i) {
+        asyncLog.runTimeInfo("frame %d disparity %.3f ms\n", i, i * 0.001);
+    }), "ns", "\"dropped\":" + std::to_string(asyncLog.droppedCount()));
+    asyncLog.flush();
+    report.add("async_debugTimeInfo_filtered", perCallNs([&](int i) {
+        asyncLog.debugTimeInfo("frame %d disparity %.3f ms\n", i, i * 0.001);
+    }), "ns");
+
+    // 4 producers with the default ring size, drops are expected when the writer falls behind
+    AsyncLogBackend::instance().setRingCapacity(1024);
+    uint64_t droppedBefore = asyncLog.droppedCount();
+    std::vector<BenchStats> threadStats(4);
+    std::vector<std::thread> producers;
+    for (size_t t = 0; t < threadStats.size(); ++t) {
+        producers.emplace_back([&, t]() {
+            threadStats[t] = perCallNs([&](int i) {
+                asyncLog.runTimeWarning("worker %zu frame %d late by %d us\n", t, i, i & 1023);
+            });
+        });
+    }
+    for (auto &th : producers) {
+        th.join();
+    }
+    asyncLog.flush();
+    for (size_t t = 0; t < threadStats.size(); ++t) {
+        report.add("async_runTimeWarning_4threads_t" + std::to_string(t), threadStats[t], "ns",
+                   "\"dropped\":" + std::to_string(asyncLog.droppedCount() - droppedBefore));
+    }
+
+    fflush(stdout);
+    dup2(console, STDOUT_FILENO);
+    close(console);
+    return report.write(output) ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// Distance and 3D position of detected objects from the stereo depth.
+//
+// Works on the depth frames the SDK derives from its disparity after
+// startStereoCompute() (StereoCamera::getDepthFrame(), or image_server's
+// depth stream): millimetres as CV_16U, metres as CV_32F, or the SDK's 8 bit
+// gray depth stretched over [gray_min_mm, gray_max_mm]. The SDK does not
+// report that range, so distances from 8 bit depth are only as right as the
+// configured one. Boxes are given on the rectified left image, which the
+// depth frames are aligned with; the intrinsics should be the rectified ones
+// of the camera's calibration (getCalibParams(), DepthIntrinsics).
+//
+// Only pixels inside the boxes are read, on a grid thinned out to at most
+// max_samples per box; no point cloud is made. Invalid (0) depth is skipped.
+// The distance is the median of the valid samples, near_m a low percentile
+// (the closest part of the object), and the position the mean of the back
+// projected samples within `inlier` of the median, so background showing
+// through the box does not pull the centroid away.
+
+struct BoxDepthOptions {
+    float percentile = 0.1f;     // of near_m
+    float inner = 0.6f;          // central part of the box that is sampled, fraction of its width and height
+    float inlier = 0.1f;         // relative depth band around the median used for the position
+    int max_samples = 1024;      // pixels read per box at most
+    int gray_min_mm = 50;        // assumed range of 8 bit depth frames, see depthToMillimetres()
+    int gray_max_mm = 1000;
+};
+
+// Pinhole intrinsics of the depth frames, in their pixels.
+struct PinholeIntrinsics {
+    float fx = 0, fy = 0, cx = 0, cy = 0;
+
+    // Square pixels, principal point at the centre, hfov_deg across the width.
+    // A guess for when no calibration is known.
+    static PinholeIntrinsics fromHfov(cv::Size size, float hfov_deg = 90)
+    {
+        PinholeIntrinsics k;
+        k.fx = k.fy = size.width / 2.0f / std::tan(hfov_deg * (float)CV_PI / 360.0f);
+        k.cx = size.width / 2.0f;
+        k.cy = size.height / 2.0f;
+        return k;
+    }
+};
+
+struct BoxDepth {
+    int samples = 0;             // pixels read
+    int valid = 0;               // of those with depth
+    float median_m = 0;          // distance, 0 if there was no valid pixel
+    float near_m = 0;
+    cv::Point3f camera;          // centroid in the camera frame (x right, y down, z forward), metres
+    cv::Point3f body;            // the same in the body frame, if a transform was set, otherwise = camera
+    bool ok() const { return valid > 0; }
+};
+
+class BoxDepthEstimator {
+public:
+    explicit BoxDepthEstimator(const PinholeIntrinsics &k, const BoxDepthOptions &opt = BoxDepthOptions())
+        : k_(k), opt_(opt)
+    {
+        samples_.reserve(std::max(opt_.max_samples, 1));
+    }
+
+    void setIntrinsics(const PinholeIntrinsics &k) { k_ = k; }
+    const PinholeIntrinsics &intrinsics() const { return k_; }
+
+    // Camera to body frame: p_body = R * p_camera + t, see cameraToBody().
+    void setBodyTransform(const cv::Matx33f &R, const cv::Vec3f &t)
+    {
+        R_ = R;
+        t_ = t;
+    }
+
+    // Rotation from the camera frame (x right, y down, z forward) to a body
+    // frame with x forward, y left and z up, for a camera looking forward and
+    // pitched down by pitch_deg.
+    static cv::Matx33f cameraToBody(float pitch_deg)
+    {
+        float a = pitch_deg * (float)CV_PI / 180.0f, c = std::cos(a), s = std::sin(a);
+        cv::Matx33f axes(0, 0, 1,
+                         -1, 0, 0,
+                         0, -1, 0);
+        cv::Matx33f pitch(c, 0, s,
+                          0, 1, 0,
+                          -s, 0, c);
+        return pitch * axes;
+    }
+
+    // Estimates from the pixels of box (depth frame pixels). Returns out.ok().
+    bool estimate(const cv::Mat &depth, const cv::Rect2f &box, BoxDepth &out)
+    {
+        out = BoxDepth();
+        // central part of the box, clipped to the frame
+        float w = box.width * opt_.inner, h = box.height * opt_.inner;
+        int x0 = std::max(0, (int)std::floor(box.x + (box.width - w) / 2));
+        int y0 = std::max(0, (int)std::floor(box.y + (box.height - h) / 2));
+        int x1 = std::min(depth.cols, (int)std::ceil(box.x + (box.width + w) / 2));
+        int y1 = std::min(depth.rows, (int)std::ceil(box.y + (box.height + h) / 2));
+        if (x1 <= x0 || y1 <= y0 || depth.channels() != 1) {
+            return false;
+        }
+        int step = std::max(1, (int)std::ceil(std::sqrt((double)(x1 - x0) * (y1 - y0) / std::max(opt_.max_samples, 1))));
+
+        samples_.clear();
+        switch (depth.depth()) {
+        case CV_16U:
+            gather<uint16_t>(depth, x0, y0, x1, y1, step, out, [](uint16_t v) { return v * 0.001f; });
+            break;
+        case CV_32F:
+            gather<float>(depth, x0, y0, x1, y1, step, out, [](float v) { return std::isfinite(v) ? v : 0.0f; });
+            break;
+        case CV_8U: {
+            float scale = (opt_.gray_max_mm - opt_.gray_min_mm) / 255.0f * 0.001f, offset = opt_.gray_min_mm * 0.001f;
+            gather<uint8_t>(depth, x0, y0, x1, y1, step, out,
+                            [scale, offset](uint8_t v) { return v ? v * scale + offset : 0.0f; });
+            break;
+        }
+        default:
+            return false;
+        }
+        out.valid = (int)samples_.size();
+        if (samples_.empty()) {
+            return false;
+        }
+
+        auto byDepth = [](const Sample &a, const Sample &b) { return a.z < b.z; };
+        size_t n = samples_.size();
+        std::nth_element(samples_.begin(), samples_.begin() + n / 2, samples_.end(), byDepth);
+        out.median_m = samples_[n / 2].z;
+        size_t k = std::min(n - 1, (size_t)(opt_.percentile * (n - 1)));
+        std::nth_element(samples_.begin(), samples_.begin() + k, samples_.end(), byDepth);
+        out.near_m = samples_[k].z;
+
+        // centroid of the samples near the median depth
+        float band = out.median_m * opt_.inlier;
+        double sx = 0, sy = 0, sz = 0;
+        int count = 0;
+        for (const Sample &s : samples_) {
+            if (std::fabs(s.z - out.median_m) <= band) {
+                sx += (s.u - k_.cx) * s.z / k_.fx;
+                sy += (s.v - k_.cy) * s.z / k_.fy;
+                sz += s.z;
+                count++;
+            }
+        }
+        out.camera = cv::Point3f((float)(sx / count), (float)(sy / count), (float)(sz / count));
+        cv::Vec3f body = R_ * cv::Vec3f(out.camera.x, out.camera.y, out.camera.z) + t_;
+        out.body = cv::Point3f(body[0], body[1], body[2]);
+        return true;
+    }
+
+    // Depth frame pixels of a darknet style box (relative centre x, y and size w, h)
+    // detected on an image which shows `region` of the depth frame.
+    template <typename Box>
+    static cv::Rect2f boxInDepth(const Box &b, const cv::Rect2f &region)
+    {
+        return cv::Rect2f(region.x + (b.x - b.w / 2) * region.width, region.y + (b.y - b.h / 2) * region.height,
+                          b.w * region.width, b.h * region.height);
+    }
+
+private:
+    struct Sample {
+        float z, u, v;
+    };
+
+    PinholeIntrinsics k_;
+    BoxDepthOptions opt_;
+    cv::Matx33f R_ = cv::Matx33f::eye();
+    cv::Vec3f t_ = cv::Vec3f(0, 0, 0);
+    std::vector<Sample> samples_;  // reserved for max_samples, a box never allocates
+
+    template <typename T, typename ToMetres>
+    void gather(const cv::Mat &depth, int x0, int y0, int x1, int y1, int step, BoxDepth &out, ToMetres toMetres)
+    {
+        for (int y = y0 + step / 2; y < y1; y += step) {
+            const T *row = depth.ptr<T>(y);
+            for (int x = x0 + step / 2; x < x1; x += step) {
+                out.samples++;
+                float z = toMetres(row[x]);
+                if (z > 0 && samples_.size() < samples_.capacity()) {
+                    samples_.push_back({z, (float)x, (float)y});
+                }
+            }
+        }
+    }
+};
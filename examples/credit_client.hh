@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <zmq.hpp>
+#include "frame_protocol.hh"
+
+// DEALER client of the image_server credit endpoint (--credit).
+//
+// Keeps a window of frames granted to the server. The window follows the
+// bandwidth-delay product of the link: the probed round trip time divided by
+// the interval at which frames can actually be used, which is the slower of
+// the arrival interval and the time the application spends between next()
+// calls, plus one frame of slack. A fast link and a fast consumer keep one or
+// two frames in flight; a slow link grows the window up to max_credits so the
+// server never waits for a request; a slow consumer shrinks it so frames do
+// not pile up in front of it.
+
+class CreditClient {
+public:
+    CreditClient(zmq::context_t &context, const std::string &endpoint, const FrameRequest &req,
+                 int min_credits = 1, int max_credits = 8)
+        : socket_(context, ZMQ_DEALER), request_(req), min_credits_(std::max(min_credits, 1)),
+          max_credits_(std::max(max_credits, std::max(min_credits, 1))), window_(min_credits_)
+    {
+        socket_.set(zmq::sockopt::linger, 0);
+        socket_.connect(endpoint);
+        grant(true);
+    }
+
+    // Returns the next frame, in capture order, or false if none arrived within timeout.
+    bool next(FrameMessage &frame, std::chrono::milliseconds timeout)
+    {
+        int64_t call_us = wallClockUs();
+        if (return_us_ > 0) {
+            smooth(consume_us_, (double)(call_us - return_us_));
+        }
+        int64_t deadline_us = call_us + timeout.count() * 1000;
+        while (true) {
+            drain();
+            int64_t now_us = wallClockUs();
+            if (!queue_.empty()) {
+                frame = std::move(queue_.front());
+                queue_.pop_front();
+                updateWindow();
+                grant(now_us - probe_us_ > kProbeIntervalUs);
+                return_us_ = wallClockUs();
+                return true;
+            }
+            // credits are lost when the server restarts or forgets an idle client, start over
+            int64_t stall_us = std::max<int64_t>(kStallUs, (int64_t)(4 * rtt_us_));
+            if (outstanding_ > 0 && now_us - std::max(last_arrival_us_, grant_us_) > stall_us) {
+                outstanding_ = 0;
+                lost_++;
+                grant(true);
+            } else if (now_us - probe_us_ > kProbeIntervalUs) {
+                grant(true);
+            }
+            if (now_us >= deadline_us) {
+                return_us_ = 0;  // waiting is not consumer time
+                return false;
+            }
+            zmq::pollitem_t items[] = {{socket_.handle(), 0, ZMQ_POLLIN, 0}};
+            zmq::poll(items, 1, std::chrono::milliseconds(std::min<int64_t>((deadline_us - now_us) / 1000 + 1, 100)));
+        }
+    }
+
+    // Frames requested by later grants use req.
+    void setRequest(const FrameRequest &req) { request_ = req; }
+
+    int window() const { return window_; }
+    int outstanding() const { return outstanding_; }
+    double rttMs() const { return rtt_us_ / 1000.0; }
+    double arrivalIntervalMs() const { return arrival_us_ / 1000.0; }
+    double consumeMs() const { return consume_us_ / 1000.0; }
+    uint64_t received() const { return received_; }
+    uint64_t lostGrants() const { return lost_; }
+
+private:
+    static constexpr int64_t kProbeIntervalUs = 1000 * 1000;  // also keeps the server from forgetting us
+    static constexpr int64_t kStallUs = 2 * 1000 * 1000;
+    static constexpr double kSmoothing = 0.125;
+
+    zmq::socket_t socket_;
+    FrameRequest request_;
+    int min_credits_;
+    int max_credits_;
+    int window_;
+    int outstanding_ = 0;  // granted frames which have not arrived yet
+    std::deque<FrameMessage> queue_;
+    int64_t probe_us_ = 0;         // send time of the outstanding probe, or of the last one
+    bool probing_ = false;
+    int64_t grant_us_ = 0;
+    int64_t last_arrival_us_ = 0;
+    int64_t return_us_ = 0;
+    double rtt_us_ = 0;
+    double arrival_us_ = 0;
+    double consume_us_ = 0;
+    uint64_t received_ = 0;
+    uint64_t lost_ = 0;
+
+    static void smooth(double &avg, double sample)
+    {
+        avg = avg > 0 ? avg + kSmoothing * (sample - avg) : sample;
+    }
+
+    // Tops the window up, optionally with a round trip probe.
+    void grant(bool probe)
+    {
+        int64_t now_us = wallClockUs();
+        int credits = window_ - outstanding_ - (int)queue_.size();
+        probe = probe && (!probing_ || now_us - probe_us_ > kStallUs);  // the reply of a lost probe never comes
+        if (credits <= 0 && !probe) {
+            return;
+        }
+        FrameCredit msg;
+        msg.credits = (uint16_t)std::max(credits, 0);
+        msg.flags = probe ? FRAME_CREDIT_PROBE : 0;
+        msg.request = request_;
+        if (!socket_.send(zmq::buffer(&msg, sizeof(msg)), zmq::send_flags::dontwait)) {
+            return;
+        }
+        outstanding_ += msg.credits;
+        grant_us_ = now_us;
+        if (probe) {
+            probe_us_ = now_us;
+            probing_ = true;
+        }
+    }
+
+    void drain()
+    {
+        zmq::pollitem_t items[] = {{socket_.handle(), 0, ZMQ_POLLIN, 0}};
+        while (zmq::poll(items, 1, std::chrono::milliseconds(0)) > 0 && (items[0].revents & ZMQ_POLLIN)) {
+            FrameMessage frame;
+            if (!recvFrameMessage(socket_, frame)) {
+                continue;
+            }
+            int64_t now_us = wallClockUs();
+            if (frame.header.parts == FRAME_PART_NONE) {  // probe reply
+                if (probing_) {
+                    smooth(rtt_us_, (double)(now_us - probe_us_));
+                    probing_ = false;
+                }
+                continue;
+            }
+            if (last_arrival_us_ > 0) {
+                smooth(arrival_us_, (double)(now_us - last_arrival_us_));
+            }
+            last_arrival_us_ = now_us;
+            outstanding_ = std::max(outstanding_ - 1, 0);
+            received_++;
+            queue_.push_back(std::move(frame));
+        }
+    }
+
+    void updateWindow()
+    {
+        double interval_us = std::max(arrival_us_, consume_us_);
+        if (rtt_us_ <= 0 || interval_us <= 0) {
+            return;
+        }
+        int window = (int)std::ceil(rtt_us_ / interval_us) + 1;
+        window_ = std::min(std::max(window, min_credits_), max_credits_);
+    }
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <map>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include <zmq.hpp>
+#include <PipelineTrace.hpp>
+#include "frame_encoder.hh"
+#include "frame_protocol.hh"
+
+// Credit endpoint of image_server (ROUTER).
+//
+// Each DEALER client grants a number of frames with FrameCredit messages.
+// Every newly captured frame is submitted to the shared FrameEncoder for each
+// client that still has credit, and pushed as soon as it is encoded, so up to
+// the granted number of frames are in flight at once instead of one per round
+// trip. Clients which have not sent anything for a while are forgotten.
+
+class CreditServer {
+public:
+    CreditServer(zmq::context_t &context, int port, FrameEncoder &encoder, int default_quality, int hwm = 16)
+        : socket_(context, ZMQ_ROUTER), encoder_(encoder), default_quality_(default_quality)
+    {
+        socket_.set(zmq::sockopt::sndhwm, hwm);
+        socket_.set(zmq::sockopt::linger, 0);
+        socket_.bind("tcp://*:" + std::to_string(port));
+    }
+
+    zmq::socket_t &socket() { return socket_; }
+    size_t clients() const { return clients_.size(); }
+
+    // Reads every queued credit message, answers probes.
+    void receive()
+    {
+        while (true) {
+            zmq::message_t id, msg;
+            if (!socket_.recv(id, zmq::recv_flags::dontwait)) {
+                break;
+            }
+            bool more = id.more();
+            while (more) {  // the credit is the last part, skip anything else
+                (void)socket_.recv(msg);
+                more = msg.more();
+            }
+
+            FrameCredit credit;
+            if (!parseFrameCredit(msg, credit)) {
+                continue;
+            }
+            Client &client = clients_[id.to_string()];
+            client.credits = std::min(client.credits + credit.credits, kMaxCredits);
+            client.params = encodeParams(credit.request, default_quality_);
+            client.last_us = wallClockUs();
+            if (credit.flags & FRAME_CREDIT_PROBE) {
+                FrameHeader hdr;
+                socket_.send(id, zmq::send_flags::sndmore | zmq::send_flags::dontwait);
+                socket_.send(zmq::buffer(&hdr, sizeof(hdr)), zmq::send_flags::dontwait);
+            }
+        }
+        evictIdle();
+    }
+
+    // Starts encoding a new frame for every client with credit left.
+    void onFrame(uint64_t seq, int64_t capture_us, const cv::Mat &raw)
+    {
+        int64_t now_us = wallClockUs();
+        for (auto &entry : clients_) {
+            Client &client = entry.second;
+            if (client.credits > 0 && client.params.parts != FRAME_PART_NONE) {
+                client.credits--;
+                client.pending.push_back({encoder_.submit(seq, capture_us, raw, client.params), now_us});
+            }
+        }
+    }
+
+    // Pushes encoded frames, in capture order per client. Returns true while frames are still being encoded.
+    bool flush()
+    {
+        bool busy = false;
+        for (auto &entry : clients_) {
+            Client &client = entry.second;
+            while (!client.pending.empty() &&
+                   client.pending.front().frame.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                EncodedFramePtr encoded = client.pending.front().frame.get();
+                uint32_t server_us = (uint32_t)(wallClockUs() - client.pending.front().start_us);
+                client.pending.pop_front();
+                // the encoder dropped the job, or replaced it by a frame already sent: the credit stays
+                if (!encoded || encoded->header.seq <= client.sent_seq) {
+                    client.credits = std::min(client.credits + 1, kMaxCredits);
+                    continue;
+                }
+                client.sent_seq = encoded->header.seq;
+                PIPELINE_TRACE_SCOPE("zmq_push", encoded->header.seq);
+                // a full pipe (or a client which is gone) drops the frame, its credit is spent either way
+                zmq::message_t id(entry.first.data(), entry.first.size());
+                if (socket_.send(id, zmq::send_flags::sndmore | zmq::send_flags::dontwait)) {
+                    sendEncodedFrame(socket_, encoded, server_us, zmq::send_flags::dontwait);
+                }
+            }
+            busy = busy || !client.pending.empty();
+        }
+        return busy;
+    }
+
+private:
+    static constexpr int64_t kIdleUs = 10 * 1000 * 1000;  // clients probe every second, see CreditClient
+    static constexpr int kMaxCredits = 64;
+
+    struct Pending {
+        std::shared_future<EncodedFramePtr> frame;
+        int64_t start_us;
+    };
+
+    struct Client {
+        int credits = 0;
+        EncodeParams params;
+        int64_t last_us = 0;
+        uint64_t sent_seq = 0;
+        std::deque<Pending> pending;
+    };
+
+    zmq::socket_t socket_;
+    FrameEncoder &encoder_;
+    int default_quality_;
+    std::map<std::string, Client> clients_;  // by ROUTER identity
+
+    void evictIdle()
+    {
+        int64_t now_us = wallClockUs();
+        for (auto it = clients_.begin(); it != clients_.end();) {
+            if (now_us - it->second.last_us > kIdleUs && it->second.pending.empty()) {
+                it = clients_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "frame_protocol.hh"
+
+// Transport encoding of the depth output of image_server: metric depth in
+// millimetres, CV_16U, as lossless 16 bit PNG. The stereo camera's
+// getDepthFrame() only returns 8 bit display depth, so image_server makes the
+// millimetres from the SDK's metric point cloud (cloudToMillimetres()). The
+// 8 bit frame is a fallback when the camera has no calibration: 256 levels
+// over an assumed range (3.7 mm steps over the default 50..1000 mm), only as
+// right as that range, flagged FRAME_DEPTH_8BIT. Point clouds use
+// PointCloudCodec.
+
+static const int kPngCompression = 1;  // fast levels already get most of the gain on depth
+
+// Converts an SDK depth frame to millimetres. CV_16U is taken as millimetres,
+// floating point as metres. 8 bit gray depth is the SDK's display depth: the
+// SDK does not report its range, gray level g is taken as
+// min_mm + g * (max_mm - min_mm) / 255 (image_server --depth-range), 0 as invalid.
+inline void depthToMillimetres(const cv::Mat &depth, cv::Mat &mm, int min_mm = 50, int max_mm = 1000)
+{
+    switch (depth.depth()) {
+    case CV_16U:
+        mm = depth;
+        break;
+    case CV_32F:
+    case CV_64F:
+        depth.convertTo(mm, CV_16U, 1000.0);
+        break;
+    default: {
+        cv::Mat gray = depth;
+        if (gray.channels() != 1) {
+            cv::cvtColor(depth, gray, cv::COLOR_BGR2GRAY);
+        }
+        cv::Mat valid = gray > 0;
+        gray.convertTo(mm, CV_16U, (max_mm - min_mm) / 255.0, min_mm);
+        mm.setTo(0, ~valid);
+        break;
+    }
+    }
+}
+
+// Metric depth from the SDK's point cloud (metres, left rectified camera frame):
+// every point is projected through the rectified intrinsics k into a size
+// image of millimetres, the nearest point wins a pixel, pixels without a point
+// are 0 (invalid).
+inline void cloudToMillimetres(const std::vector<cv::Vec3f> &pcl, const DepthIntrinsics &k, cv::Size size, cv::Mat &mm)
+{
+    mm.create(size.height, size.width, CV_16U);
+    mm.setTo(cv::Scalar(0));
+    for (const cv::Vec3f &p : pcl) {
+        float z = p[2];
+        if (!(z > 0) || z >= 65.535f) {
+            continue;
+        }
+        float u = k.fx * p[0] / z + k.cx, v = k.fy * p[1] / z + k.cy;
+        if (!(u >= 0 && v >= 0 && u < size.width - 0.5f && v < size.height - 0.5f)) {
+            continue;
+        }
+        uint16_t d = (uint16_t)std::max(1.0f, std::round(z * 1000));
+        uint16_t &pixel = mm.at<uint16_t>((int)(v + 0.5f), (int)(u + 0.5f));
+        if (pixel == 0 || d < pixel) {
+            pixel = d;
+        }
+    }
+}
+
+inline bool encodeDepth(const cv::Mat &mm, std::vector<uint8_t> &out)
+{
+    std::vector<int> param = {cv::IMWRITE_PNG_COMPRESSION, kPngCompression};
+    return cv::imencode(".png", mm, out, param);
+}
+
+inline bool decodeDepth(const uint8_t *data, size_t size, cv::Mat &mm)
+{
+    mm = cv::imdecode(cv::Mat(1, (int)size, CV_8U, const_cast<uint8_t *>(data)), cv::IMREAD_UNCHANGED);
+    return !mm.empty() && mm.type() == CV_16U;
+}
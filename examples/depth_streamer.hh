@@ -0,0 +1,191 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <zmq.hpp>
+#include <PipelineTrace.hpp>
+#include <PointCloudCodec.hpp>
+#include "depth_codec.hh"
+#include "frame_protocol.hh"
+
+// Depth and point cloud endpoints of image_server.
+//
+// Runs next to the image loop on its own thread, reading the stereo outputs
+// of the same camera (after startStereoCompute) and publishing every new
+// depth frame / point cloud on its own PUB socket. Messages have the layout
+// of the image stream: one message, FrameHeader followed by the payload
+// (left part), with the SDK time stamp in capture_us so depth, clouds and
+// images can be aligned. Depth frames also carry the rectified intrinsics of
+// the camera's calibration (DepthIntrinsics, right part), read once at start.
+//
+// With a calibration the depth frames are metric: the point cloud projected
+// through those intrinsics (cloudToMillimetres()) at the size of the SDK's
+// depth frames, time stamped like the cloud. Without one the SDK's 8 bit
+// display depth is sent, flagged FRAME_DEPTH_8BIT.
+
+struct DepthStreamOptions {
+    bool depth = false;        // publish metric depth in millimetres
+    int depthPort = 25663;
+    bool cloud = false;        // publish point clouds
+    int cloudPort = 25664;
+    int hwm = 2;               // messages queued per subscriber before new ones are dropped
+    int grayMinMm = 50;        // assumed range of the 8 bit fallback, see depthToMillimetres()
+    int grayMaxMm = 1000;
+    bool grayRangeSet = false; // the range was configured rather than left at the guess above
+    float cloudPrecision = 0.0005f;  // maximum point cloud coordinate error, metres
+    int cloudZstdLevel = 1;    // zstd level of point clouds, 0 = bit packing only
+
+    bool enabled() const { return depth || cloud; }
+};
+
+template <typename Camera>
+class DepthStreamer {
+public:
+    DepthStreamer(zmq::context_t &context, Camera &cam, const DepthStreamOptions &opt)
+        : context_(context), cam_(cam), opt_(opt)
+    {
+        if (opt_.enabled()) {
+            worker_ = std::thread(&DepthStreamer::run, this);
+        }
+    }
+
+    ~DepthStreamer()
+    {
+        running_ = false;
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+    }
+
+private:
+    zmq::context_t &context_;
+    Camera &cam_;
+    DepthStreamOptions opt_;
+    std::atomic<bool> running_{true};
+    std::thread worker_;
+
+    zmq::socket_t bindPublisher(int port)
+    {
+        zmq::socket_t socket(context_, ZMQ_PUB);
+        socket.set(zmq::sockopt::sndhwm, opt_.hwm);
+        socket.set(zmq::sockopt::linger, 0);
+        socket.bind("tcp://*:" + std::to_string(port));
+        return socket;
+    }
+
+    static void publishDepth(zmq::socket_t &socket, uint64_t seq, std::chrono::microseconds t, int64_t start_us,
+                             const cv::Mat &mm, uint8_t flags, std::vector<uint8_t> &payload, const DepthIntrinsics *intrinsics)
+    {
+        if (!encodeDepth(mm, payload)) {
+            return;
+        }
+        FrameHeader hdr;
+        hdr.encoding = FRAME_ENCODING_PNG16_DEPTH;
+        hdr.flags = flags;
+        hdr.seq = seq;
+        hdr.capture_us = t.count();
+        hdr.encode_us = (uint32_t)(wallClockUs() - start_us);
+        hdr.width = (uint16_t)mm.cols;
+        hdr.height = (uint16_t)mm.rows;
+        publish(socket, hdr, payload, intrinsics);
+    }
+
+    static void publish(zmq::socket_t &socket, FrameHeader &hdr, const std::vector<uint8_t> &payload,
+                        const DepthIntrinsics *intrinsics = nullptr)
+    {
+        hdr.parts = intrinsics ? FRAME_PART_BOTH : FRAME_PART_LEFT;
+        hdr.left_bytes = (uint32_t)payload.size();
+        hdr.right_bytes = intrinsics ? (uint32_t)sizeof(DepthIntrinsics) : 0;
+        zmq::message_t msg(sizeof(FrameHeader) + hdr.left_bytes + hdr.right_bytes);
+        uint8_t *p = static_cast<uint8_t *>(msg.data());
+        memcpy(p, &hdr, sizeof(FrameHeader));
+        memcpy(p + sizeof(FrameHeader), payload.data(), payload.size());
+        if (intrinsics) {
+            memcpy(p + sizeof(FrameHeader) + payload.size(), intrinsics, sizeof(DepthIntrinsics));
+        }
+        socket.send(msg, zmq::send_flags::dontwait);
+    }
+
+    // Rectified intrinsics (kfe, the last of getCalibParams()) of the left camera.
+    bool calibIntrinsics(DepthIntrinsics &k)
+    {
+        std::vector<cv::Mat> params;
+        if (!cam_.getCalibParams(params) || params.size() < 6 || params[5].rows != 3 || params[5].cols != 3) {
+            return false;
+        }
+        cv::Mat kfe;
+        params[5].convertTo(kfe, CV_64F);
+        k.fx = (float)kfe.at<double>(0, 0);
+        k.fy = (float)kfe.at<double>(1, 1);
+        k.cx = (float)kfe.at<double>(0, 2);
+        k.cy = (float)kfe.at<double>(1, 2);
+        return k.fx > 0 && k.fy > 0;
+    }
+
+    void run()
+    {
+        PipelineTracer::instance().setThreadName("depth streamer");
+        zmq::socket_t depthSocket = opt_.depth ? bindPublisher(opt_.depthPort) : zmq::socket_t();
+        zmq::socket_t cloudSocket = opt_.cloud ? bindPublisher(opt_.cloudPort) : zmq::socket_t();
+
+        std::chrono::microseconds depthStamp(0), cloudStamp(0);
+        uint64_t depthSeq = 0, cloudSeq = 0;
+        cv::Mat depth, mm;
+        PointCloudCodec codec(opt_.cloudPrecision);
+        codec.setCompressionLevel(opt_.cloudZstdLevel);
+        std::vector<cv::Vec3f> pcl;
+        std::vector<uint8_t> payload;
+        DepthIntrinsics intrinsics;
+        bool metric = opt_.depth && calibIntrinsics(intrinsics);  // depth from the cloud, else the 8 bit fallback
+        cv::Size depthSize;
+        while (running_) {
+            bool idle = true;
+            std::chrono::microseconds t;
+            if (opt_.depth && !metric && cam_.getDepthFrame(depth, false, t) && t != depthStamp) {
+                PIPELINE_TRACE_SCOPE(TRACE_DEPTH, depthSeq);
+                int64_t start_us = wallClockUs();
+                depthToMillimetres(depth, mm, opt_.grayMinMm, opt_.grayMaxMm);
+                uint8_t flags = depth.depth() == CV_8U ? FRAME_DEPTH_8BIT | (opt_.grayRangeSet ? FRAME_DEPTH_RANGE_SET : 0) : 0;
+                publishDepth(depthSocket, ++depthSeq, t, start_us, mm, flags, payload, nullptr);
+                depthStamp = t;
+                idle = false;
+            }
+            if ((opt_.cloud || metric) && cam_.getPointCloud(pcl, t) && t != cloudStamp) {
+                if (metric) {
+                    PIPELINE_TRACE_SCOPE(TRACE_DEPTH, depthSeq);
+                    int64_t start_us = wallClockUs();
+                    if (depthSize.area() == 0) {  // the SDK's depth frames are as large as its rectified images
+                        std::chrono::microseconds unused;
+                        depthSize = cam_.getDepthFrame(depth, false, unused)
+                                        ? depth.size()
+                                        : cv::Size(cvRound(2 * intrinsics.cx), cvRound(2 * intrinsics.cy));
+                    }
+                    cloudToMillimetres(pcl, intrinsics, depthSize, mm);
+                    publishDepth(depthSocket, ++depthSeq, t, start_us, mm, 0, payload, &intrinsics);
+                }
+                if (opt_.cloud) {
+                    PIPELINE_TRACE_SCOPE(TRACE_POINT_CLOUD, cloudSeq);
+                    int64_t start_us = wallClockUs();
+                    if (codec.encode(pcl, payload)) {
+                        FrameHeader hdr;
+                        hdr.encoding = FRAME_ENCODING_POINT_CLOUD;
+                        hdr.seq = ++cloudSeq;
+                        hdr.capture_us = t.count();
+                        hdr.encode_us = (uint32_t)(wallClockUs() - start_us);
+                        publish(cloudSocket, hdr, payload);
+                    }
+                }
+                cloudStamp = t;
+                idle = false;
+            }
+            if (idle) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+};
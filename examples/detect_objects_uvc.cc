@@ -8,6 +8,9 @@
 #include <thread>
 #include <chrono>
 #include "object_detector.hh"
+#include "object_tracker.hh"
+#include "motion_gate.hh"
+#include "detection_protocol.hh"
 #include <boost/asio.hpp>
 
 std::string getTimeStampedFolderName() {
@@ -27,12 +30,44 @@ std::string getTimeStampedFolderName() {
     return ss.str();
 }
 
-void detect_and_send(ObjectDetector &detector, boost::asio::ip::udp::socket &socket, cv::Mat &image, const std::string &camera_name)
+// Detects objects in image, or on frames between detections (--detect-every)
+// propagates the tracked boxes. Every object gets a track id. With a motion
+// gate (--motion-gate) frames without change keep the previous objects, one
+// frame older. age counts the frames since the detector last ran.
+// Detections go to UDP port 12346 on localhost as one binary datagram per frame
+// (examples/detection_protocol.hh, camera id 0), with --csv in the former text format.
+void detect_and_send(ObjectDetector &detector, ObjectTracker<DetectedObject> &tracker, MotionGate *gate,
+                     boost::asio::ip::udp::socket &socket, const boost::asio::ip::udp::endpoint &endpoint,
+                     cv::Mat &image, const std::string &camera_name, std::vector<DetectedObject> &objects,
+                     DetectionDatagram &datagram, DetectionHeader hdr, int &age, bool csv)
 {
-    boost::asio::ip::udp::endpoint endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 12346);
-    std::vector<DetectedObject> objects = detector.detect(image);
+    if (gate != nullptr && !gate->changed(image)) {
+        for (DetectedObject &obj : objects) {
+            obj.age++;
+        }
+        age++;
+    } else if (tracker.needDetection()) {
+        auto t0 = std::chrono::steady_clock::now();
+        detector.detect(image, objects);
+        if (gate != nullptr) {
+            gate->accept();
+            gate->addInference(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+        }
+        tracker.update(image, objects);
+        age = 0;
+    } else {
+        tracker.propagate(image, objects);
+        age++;
+    }
+    hdr.age = (uint16_t)std::min(age, 65535);
+    if (!csv) {
+        datagram.build(hdr, objects);
+        socket.send_to(boost::asio::buffer(datagram.data(), datagram.size()), endpoint);
+        return;
+    }
     for (const DetectedObject& obj : objects) {
-        std::cout << "  Name: " << obj.name
+        std::cout << "  Track: " << obj.track_id
+                  << ", Name: " << obj.name
                   << ", Confidence: " << obj.confidence
                   << ", Bbox: (" << obj.bbox.x << ", " << obj.bbox.y << ", "
                                  << obj.bbox.w << ", " << obj.bbox.h << ")" << std::endl;
@@ -48,10 +83,32 @@ void detect_and_send(ObjectDetector &detector, boost::asio::ip::udp::socket &soc
     }
 }
 
+// usage: detect_objects_uvc cfg weights data [--csv] [--detect-every n] [--flow] [--motion-gate]
 int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        std::cerr << "usage: " << argv[0] << " cfg weights data [--csv] [--detect-every n] [--flow] [--motion-gate]" << std::endl;
+        return 1;
+    }
     boost::asio::io_service io_service;
     boost::asio::ip::udp::socket socket(io_service);
     socket.open(boost::asio::ip::udp::v4());
+    boost::asio::ip::udp::endpoint endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 12346);
+    bool csv = false;
+    TrackerOptions tracking;
+    tracking.interval = 1;
+    bool useGate = false;
+    for (int i = 4; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--csv") {
+            csv = true;
+        } else if (arg == "--detect-every" && i + 1 < argc) {
+            tracking.interval = std::max(std::stoi(argv[++i]), 1);
+        } else if (arg == "--flow") {
+            tracking.use_flow = true;
+        } else if (arg == "--motion-gate") {
+            useGate = true;
+        }
+    }
 
     cv::VideoCapture cap(0);
     if (!cap.isOpened()) {
@@ -60,11 +117,16 @@ int main(int argc, char *argv[]) {
     }
 
     ObjectDetector detector(argv[1], argv[2], argv[3]);
+    ObjectTracker<DetectedObject> tracker(tracking);
+    MotionGate gate;
+    int age = 0;
     // Generate time stamped folder name and create the directory
     std::string folderName1 = getTimeStampedFolderName() + "_webcam";
     std::filesystem::create_directories(folderName1);
 
     int counter = 0;
+    std::vector<DetectedObject> objects;  // reused across frames
+    DetectionDatagram datagram;
 
     while (true) {
         cv::Mat frame;
@@ -73,7 +135,12 @@ int main(int argc, char *argv[]) {
             break;
         }
         cv::resize(frame, frame, cv::Size(), 0.5, 0.5);
-        detect_and_send(detector, socket, frame, "camera_front");
+        DetectionHeader hdr;
+        hdr.seq = counter;
+        hdr.capture_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::system_clock::now().time_since_epoch()).count();
+        detect_and_send(detector, tracker, useGate ? &gate : nullptr, socket, endpoint, frame, "camera_front", objects,
+                        datagram, hdr, age, csv);
 #if 0
         std::stringstream ss1;
         ss1 << folderName1 << "/image_" << std::setfill('0') << std::setw(5) << counter << ".jpg";
@@ -90,6 +157,12 @@ int main(int argc, char *argv[]) {
         if (key == 'q') {
             break;
         }
+        if (counter % 300 == 0) {
+            tracker.printStats("front");
+            if (useGate) {
+                gate.printStats("front");
+            }
+        }
 
         //std::this_thread::sleep_for(std::chrono::seconds(200));
     }
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Binary detection results of the detection receivers, sent over UDP.
+//
+// One datagram per processed frame, also when nothing was found: a
+// DetectionHeader naming the camera and the frame (the server's sequence
+// number and capture time stamp, see FrameHeader) followed by `count`
+// fixed size DetectionRecords (class, confidence, box and, when the sender
+// has depth, distance and 3D position). Packed, little endian. Records beyond
+// kMaxDetectionRecords are left out and DETECTION_TRUNCATED is set, so a
+// datagram always fits an Ethernet MTU. examples/test_recv_detection.py
+// decodes it.
+
+static const uint32_t kDetectionMagic = 0x54444355;  // "UCDT"
+static const uint8_t kDetectionProtocolVersion = 2;
+
+enum DetectionFlags : uint8_t {
+    DETECTION_TRUNCATED = 1,  // there were more objects than records
+    DETECTION_BODY_FRAME = 2, // positions are in the body frame, otherwise in the camera frame
+};
+
+#pragma pack(push, 1)
+struct DetectionHeader {
+    uint32_t magic = kDetectionMagic;
+    uint8_t version = kDetectionProtocolVersion;
+    uint8_t camera = 0;          // camera id, the index in the sender's camera list
+    uint8_t flags = 0;           // DetectionFlags
+    uint8_t reserved = 0;
+    uint16_t count = 0;          // records that follow
+    uint16_t age = 0;            // frames since the detector last ran on the camera, 0 = detected on this frame
+    uint64_t seq = 0;            // sequence number of the frame
+    int64_t capture_us = 0;      // capture time stamp of the frame, microseconds since 1970-01-01
+};
+
+struct DetectionRecord {
+    uint16_t class_id = 0;       // line of the names file
+    uint16_t track_id = 0;       // stable id of the object across frames, 0 = not tracked
+    float confidence = 0;
+    float x = 0, y = 0;          // box centre relative to the image size, 0..1
+    float w = 0, h = 0;          // box size relative to the image size
+    float distance = 0;          // metres, 0 = unknown (no depth)
+    float px = 0, py = 0, pz = 0;  // position in metres, see DETECTION_BODY_FRAME
+};
+#pragma pack(pop)
+
+static const size_t kMaxDetectionRecords = (1472 - sizeof(DetectionHeader)) / sizeof(DetectionRecord);
+
+// A datagram built in a fixed buffer, without allocation.
+class DetectionDatagram {
+public:
+    void begin(const DetectionHeader &hdr)
+    {
+        hdr_ = hdr;
+        hdr_.count = 0;
+        hdr_.flags &= ~DETECTION_TRUNCATED;
+        size_ = sizeof(DetectionHeader);
+        memcpy(buf_, &hdr_, sizeof(hdr_));
+    }
+
+    // Returns false (and marks the datagram truncated) if it is full.
+    bool add(const DetectionRecord &rec)
+    {
+        if (hdr_.count >= kMaxDetectionRecords) {
+            hdr_.flags |= DETECTION_TRUNCATED;
+            memcpy(buf_, &hdr_, sizeof(hdr_));
+            return false;
+        }
+        memcpy(buf_ + size_, &rec, sizeof(rec));
+        size_ += sizeof(rec);
+        hdr_.count++;
+        memcpy(buf_, &hdr_, sizeof(hdr_));
+        return true;
+    }
+
+    // Header plus one record per object; objects have class_id, confidence and a
+    // darknet style bbox (centre x, y and w, h, relative), like DetectedObject.
+    template <typename Objects>
+    void build(const DetectionHeader &hdr, const Objects &objects)
+    {
+        begin(hdr);
+        for (const auto &obj : objects) {
+            DetectionRecord rec;
+            rec.class_id = (uint16_t)obj.class_id;
+            rec.track_id = (uint16_t)obj.track_id;
+            rec.confidence = obj.confidence;
+            rec.x = obj.bbox.x;
+            rec.y = obj.bbox.y;
+            rec.w = obj.bbox.w;
+            rec.h = obj.bbox.h;
+            if (!add(rec)) {
+                break;
+            }
+        }
+    }
+
+    const uint8_t *data() const { return buf_; }
+    size_t size() const { return size_; }
+
+private:
+    DetectionHeader hdr_;
+    uint8_t buf_[sizeof(DetectionHeader) + kMaxDetectionRecords * sizeof(DetectionRecord)];
+    size_t size_ = 0;
+};
+
+// Returns true and fills hdr if [data, data + size) is a complete detection datagram.
+inline bool parseDetectionHeader(const void *data, size_t size, DetectionHeader &hdr)
+{
+    if (size < sizeof(DetectionHeader)) {
+        return false;
+    }
+    memcpy(&hdr, data, sizeof(hdr));
+    return hdr.magic == kDetectionMagic && hdr.version == kDetectionProtocolVersion &&
+           size == sizeof(DetectionHeader) + hdr.count * sizeof(DetectionRecord);
+}
+
+// Record i of a datagram accepted by parseDetectionHeader().
+inline DetectionRecord detectionRecord(const void *data, size_t i)
+{
+    DetectionRecord rec;
+    memcpy(&rec, static_cast<const uint8_t *>(data) + sizeof(DetectionHeader) + i * sizeof(DetectionRecord),
+           sizeof(rec));
+    return rec;
+}
@@ -9,6 +9,7 @@
   */
 
 #include <UnitreeCameraSDK.hpp>
+#include <PipelineTrace.hpp>
 #include <unistd.h>
 
 int main(int argc, char *argv[]){
@@ -20,21 +21,35 @@ int main(int argc, char *argv[]){
     cam.startCapture(); ///< disable image h264 encoding and share memory sharing
     cam.startStereoCompute(); ///< start disparity computing
     
+    PipelineTracer &tracer = PipelineTracer::instance();
+    uint64_t frameId = 0;
     while(cam.isOpened()){
         cv::Mat depth; 
         std::chrono::microseconds t;
-        if(!cam.getDepthFrame(depth, true, t)){  ///< get stereo camera depth image 
+        bool ok;
+        {
+            PIPELINE_TRACE_SCOPE(TRACE_DEPTH, frameId);
+            ok = cam.getDepthFrame(depth, true, t);  ///< get stereo camera depth image
+        }
+        if(!ok){
             usleep(1000);
             continue;
         }
+        frameId++;
         if(!depth.empty()){
             cv::imshow("UnitreeCamera-Depth", depth);
         }
+        if(tracer.windowElapsed()){
+            tracer.stop();
+            tracer.flush("depth_trace.json");
+        }
         char key = cv::waitKey(10);
         if(key == 27) // press ESC key
            break;
+        if(key == 't' && !tracer.isEnabled()) // press t to trace the next 10 seconds
+           tracer.start(std::chrono::seconds(10));
     }
-    
+
     cam.stopStereoCompute();  ///< stop disparity computing 
     cam.stopCapture();  ///< stop camera capturing
     
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+// Gathers one item per source (camera) into batches for a batched consumer.
+//
+// Each source has a latest-only slot: put() replaces an item which was not
+// consumed yet (counted as dropped), so a slow consumer always gets the
+// newest frames. collect() waits for a first item, then until every source
+// has one or the deadline since the oldest pending item has passed, so the
+// batch size follows whatever arrives within that latency budget: all
+// cameras when they are in step, fewer when one is late or gone.
+//
+// Items are swapped, not copied: put() hands back an item consumed earlier
+// for the producer to fill again, and collect() takes the caller's previous
+// items back, so cv::Mat buffers circulate without reallocation.
+
+struct BatcherStats {
+    uint64_t batches = 0;
+    uint64_t items = 0;
+    uint64_t dropped = 0;   // replaced before they were collected
+    uint64_t partial = 0;   // batches closed by the deadline with sources missing
+    double meanBatch() const { return batches ? (double)items / batches : 0.0; }
+};
+
+template <typename T>
+class FrameBatcher {
+public:
+    FrameBatcher(int sources, std::chrono::microseconds deadline)
+        : slots_(std::max(sources, 1)), deadline_(deadline)
+    {
+    }
+
+    int sources() const { return (int)slots_.size(); }
+
+    // Makes item the pending item of source; item receives a consumed one to reuse.
+    void put(int source, T &item)
+    {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            Slot &slot = slots_[source];
+            if (slot.pending) {
+                stats_.dropped++;
+            } else {
+                slot.pending = true;
+                slot.since = std::chrono::steady_clock::now();
+                pending_++;
+            }
+            std::swap(slot.item, item);
+        }
+        cond_.notify_one();
+    }
+
+    // Moves the pending items into items[source] (items has one entry per source) and lists
+    // their sources in ready, in source order. Returns false if nothing arrived within timeout
+    // or the batcher was stopped.
+    bool collect(std::vector<T> &items, std::vector<int> &ready, std::chrono::milliseconds timeout)
+    {
+        items.resize(slots_.size());
+        ready.clear();
+        std::unique_lock<std::mutex> lock(lock_);
+        if (!cond_.wait_for(lock, timeout, [this] { return stopped_ || pending_ > 0; }) || stopped_) {
+            return false;
+        }
+        // the batch closes deadline_ after its oldest frame arrived
+        auto oldest = std::chrono::steady_clock::time_point::max();
+        for (const Slot &slot : slots_) {
+            if (slot.pending) {
+                oldest = std::min(oldest, slot.since);
+            }
+        }
+        cond_.wait_until(lock, oldest + deadline_, [this] { return stopped_ || pending_ == (int)slots_.size(); });
+        if (stopped_) {
+            return false;
+        }
+        for (size_t i = 0; i < slots_.size(); ++i) {
+            Slot &slot = slots_[i];
+            if (slot.pending) {
+                std::swap(slot.item, items[i]);
+                slot.pending = false;
+                ready.push_back((int)i);
+            }
+        }
+        pending_ = 0;
+        stats_.batches++;
+        stats_.items += ready.size();
+        stats_.partial += ready.size() < slots_.size() ? 1 : 0;
+        return true;
+    }
+
+    // Wakes up and fails collect() for good.
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            stopped_ = true;
+        }
+        cond_.notify_all();
+    }
+
+    BatcherStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        return stats_;
+    }
+
+    void printStats(FILE *fp = stdout) const
+    {
+        BatcherStats s = stats();
+        fprintf(fp, "batcher: %llu batches, mean size %.2f, %llu partial, %llu frames dropped\n",
+                (unsigned long long)s.batches, s.meanBatch(), (unsigned long long)s.partial,
+                (unsigned long long)s.dropped);
+    }
+
+private:
+    struct Slot {
+        T item;
+        bool pending = false;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    std::vector<Slot> slots_;
+    std::chrono::microseconds deadline_;
+    int pending_ = 0;
+    bool stopped_ = false;
+    BatcherStats stats_;
+    mutable std::mutex lock_;
+    std::condition_variable cond_;
+};
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <zmq.hpp>
+#include <PipelineTrace.hpp>
+#include "frame_protocol.hh"
+#include "jpeg_encoder.hh"
+
+// Encode-once stage of image_server.
+//
+// Every captured frame is encoded at most once per set of EncodeParams, on a
+// small pool of worker threads so encoding overlaps with capture and serving.
+// Results are cached by capture sequence: concurrent clients asking for the
+// same frame share one buffer, which is handed to ZMQ without a copy. Buffers
+// come from a BufferPool and go back to it once the last client (or ZMQ) is
+// done with the frame.
+//
+// The queue of jobs waiting for a worker is bounded, so a stalled pool does
+// not hold on to every submitted raw frame. A queued job is stale once a newer
+// frame is submitted with the same params: the new frame takes its place and
+// its waiters get the newer encoding (check header.seq). When the queue is
+// still full the oldest queued job is dropped and resolves to nullptr.
+
+struct EncodeParams {
+    int quality = 92;                // JPEG quality
+    uint8_t parts = FRAME_PART_LEFT; // FramePart bits to encode
+    cv::Rect roi;                    // region of every part to encode, empty = whole part
+    cv::Size size;                   // size the region is scaled to, empty = unscaled
+
+    bool operator<(const EncodeParams &o) const
+    {
+        return std::tie(quality, parts, roi.x, roi.y, roi.width, roi.height, size.width, size.height) <
+               std::tie(o.quality, o.parts, o.roi.x, o.roi.y, o.roi.width, o.roi.height, o.size.width,
+                        o.size.height);
+    }
+};
+
+// Encoding a client asked for in a FrameRequest.
+inline EncodeParams encodeParams(const FrameRequest &req, int default_quality)
+{
+    EncodeParams params;
+    params.quality = req.quality > 0 ? req.quality : default_quality;
+    params.parts = req.parts & FRAME_PART_BOTH;
+    params.roi = cv::Rect(req.roi_x, req.roi_y, req.roi_width, req.roi_height);
+    params.size = cv::Size(req.width, req.height);
+    return params;
+}
+
+// Encoded parts with room for a FrameHeader in front, so the stream can
+// publish header + parts as one message straight from this buffer.
+struct EncodedFrame {
+    FrameHeader header;                // everything but server_us is filled by the encoder
+    std::shared_ptr<BufferPool> pool;  // owner of buffer
+    std::vector<uint8_t> buffer;       // header bytes followed by the encoded image, then unused capacity
+    size_t length = 0;                 // bytes in use
+
+    ~EncodedFrame()
+    {
+        if (pool) {
+            pool->release(std::move(buffer));
+        }
+    }
+
+    const uint8_t *data() const { return buffer.data(); }
+    size_t size() const { return length; }
+    const uint8_t *payload() const { return buffer.data() + sizeof(FrameHeader); }
+    size_t payloadSize() const { return length - sizeof(FrameHeader); }
+    const uint8_t *left() const { return payload(); }
+    const uint8_t *right() const { return payload() + header.left_bytes; }
+};
+
+typedef std::shared_ptr<const EncodedFrame> EncodedFramePtr;
+
+// Zero copy message over [ptr, ptr + size) of an encoded frame, the frame
+// stays alive until ZMQ is done with the message.
+inline zmq::message_t makeSharedMessage(const EncodedFramePtr &frame, const uint8_t *ptr, size_t size)
+{
+    EncodedFramePtr *hold = new EncodedFramePtr(frame);
+    return zmq::message_t(const_cast<uint8_t *>(ptr), size,
+                          [](void *, void *hint) { delete static_cast<EncodedFramePtr *>(hint); }, hold);
+}
+
+// Sends the multipart reply layout: header (with server_us), then every
+// encoded part as its own zero copy message.
+inline bool sendEncodedFrame(zmq::socket_t &socket, const EncodedFramePtr &frame, uint32_t server_us,
+                             zmq::send_flags flags = zmq::send_flags::none)
+{
+    FrameHeader hdr = frame->header;
+    hdr.server_us = server_us;
+    zmq::send_flags more = flags | zmq::send_flags::sndmore;
+    if (!socket.send(zmq::buffer(&hdr, sizeof(hdr)), hdr.parts ? more : flags)) {
+        return false;
+    }
+    if (hdr.parts & FRAME_PART_LEFT) {
+        zmq::message_t left = makeSharedMessage(frame, frame->left(), hdr.left_bytes);
+        socket.send(left, (hdr.parts & FRAME_PART_RIGHT) ? more : flags);
+    }
+    if (hdr.parts & FRAME_PART_RIGHT) {
+        zmq::message_t right = makeSharedMessage(frame, frame->right(), hdr.right_bytes);
+        socket.send(right, flags);
+    }
+    return true;
+}
+
+class FrameEncoder {
+public:
+    // max_queued: jobs waiting for a worker, 0 = twice the workers
+    FrameEncoder(int workers, size_t cached_frames, size_t max_queued = 0)
+        : cached_frames_(cached_frames > 0 ? cached_frames : 1),
+          max_queued_(max_queued > 0 ? max_queued : 2 * (size_t)(workers > 0 ? workers : 1)),
+          pool_(std::make_shared<BufferPool>())
+    {
+        for (int i = 0; i < (workers > 0 ? workers : 1); ++i) {
+            workers_.emplace_back(&FrameEncoder::run, this);
+        }
+    }
+
+    ~FrameEncoder()
+    {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            running_ = false;
+        }
+        cond_.notify_all();
+        for (auto &th : workers_) {
+            th.join();
+        }
+    }
+
+    // Encodes raw frame `seq` with params on the pool, unless it is already
+    // cached or being encoded. Never blocks on encoding. The result is a newer
+    // frame if a later submit() replaced this one while it was queued, and
+    // nullptr if the job was dropped from a full queue.
+    std::shared_future<EncodedFramePtr> submit(uint64_t seq, int64_t capture_us, const cv::Mat &raw,
+                                               const EncodeParams &params)
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        Key key(seq, params);
+        auto it = cache_.find(key);
+        if (it != cache_.end()) {
+            cache_hits_++;
+            return it->second;
+        }
+
+        if (seq > newest_seq_) {
+            newest_seq_ = seq;
+            while (!cache_.empty() && cache_.begin()->first.first + cached_frames_ <= newest_seq_) {
+                cache_.erase(cache_.begin());
+            }
+        }
+
+        // an older frame with the same params still waiting for a worker is replaced in place
+        for (Job &queued : jobs_) {
+            if (sameParams(queued.key.second, params) && queued.key.first < seq) {
+                cache_.erase(queued.key);
+                queued.superseded.push_back(std::move(queued.promise));
+                queued.promise = std::promise<EncodedFramePtr>();
+                queued.key = key;
+                queued.capture_us = capture_us;
+                queued.raw = raw;
+                std::shared_future<EncodedFramePtr> result = queued.promise.get_future().share();
+                cache_[key] = result;
+                replaced_++;
+                return result;
+            }
+        }
+
+        if (jobs_.size() >= max_queued_) {
+            Job &oldest = jobs_.front();
+            cache_.erase(oldest.key);
+            oldest.resolve(nullptr);
+            jobs_.pop_front();
+            dropped_++;
+        }
+
+        Job job;
+        job.key = key;
+        job.capture_us = capture_us;
+        job.raw = raw;
+        std::shared_future<EncodedFramePtr> result = job.promise.get_future().share();
+        cache_[key] = result;
+        jobs_.push_back(std::move(job));
+        cond_.notify_one();
+        return result;
+    }
+
+    // Blocking variant of submit(), may also return a newer frame or nullptr.
+    EncodedFramePtr get(uint64_t seq, int64_t capture_us, const cv::Mat &raw, const EncodeParams &params)
+    {
+        return submit(seq, capture_us, raw, params).get();
+    }
+
+    // Camera identity copied into every FrameHeader.
+    void setCamera(int pos_number, int serial_number)
+    {
+        pos_number_ = (uint16_t)pos_number;
+        serial_number_ = (uint32_t)serial_number;
+    }
+
+    uint64_t encodedCount() const { return encoded_; }
+    uint64_t cacheHits() const { return cache_hits_; }
+    uint64_t replacedJobs() const { return replaced_; }  // queued frames replaced by a newer one
+    uint64_t droppedJobs() const { return dropped_; }    // queued frames dropped from a full queue
+    uint64_t bufferAllocations() const { return pool_->allocations(); }
+
+private:
+    typedef std::pair<uint64_t, EncodeParams> Key;
+    struct Job {
+        Key key;
+        int64_t capture_us = 0;
+        cv::Mat raw;
+        std::promise<EncodedFramePtr> promise;
+        std::vector<std::promise<EncodedFramePtr>> superseded;  // waiters of the frames this job replaced
+
+        void resolve(const EncodedFramePtr &frame)
+        {
+            promise.set_value(frame);
+            for (auto &p : superseded) {
+                p.set_value(frame);
+            }
+        }
+    };
+
+    static bool sameParams(const EncodeParams &a, const EncodeParams &b) { return !(a < b) && !(b < a); }
+
+    size_t cached_frames_;
+    size_t max_queued_;
+    std::shared_ptr<BufferPool> pool_;
+    std::atomic<uint16_t> pos_number_{0};
+    std::atomic<uint32_t> serial_number_{0};
+    uint64_t newest_seq_ = 0;
+    std::map<Key, std::shared_future<EncodedFramePtr>> cache_;
+    std::deque<Job> jobs_;
+    std::mutex lock_;
+    std::condition_variable cond_;
+    bool running_ = true;
+    std::vector<std::thread> workers_;
+    std::atomic<uint64_t> encoded_{0};
+    std::atomic<uint64_t> cache_hits_{0};
+    std::atomic<uint64_t> replaced_{0};
+    std::atomic<uint64_t> dropped_{0};
+
+    void run()
+    {
+        PipelineTracer::instance().setThreadName("frame encoder");
+        JpegEncoder jpeg;
+        cv::Mat scaled;  // resize output, reused across frames
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(lock_);
+                cond_.wait(lock, [this] { return !running_ || !jobs_.empty(); });
+                if (jobs_.empty()) {
+                    return;
+                }
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            job.resolve(encode(jpeg, scaled, job));
+            encoded_++;
+        }
+    }
+
+    // The view itself if it already has the target size, otherwise the view scaled into scaled.
+    static const cv::Mat &fit(const cv::Mat &view, cv::Size size, cv::Mat &scaled)
+    {
+        if (view.size() == size) {
+            return view;
+        }
+        cv::resize(view, scaled, size, 0, 0, cv::INTER_AREA);
+        return scaled;
+    }
+
+    EncodedFramePtr encode(JpegEncoder &jpeg, cv::Mat &scaled, const Job &job)
+    {
+        PIPELINE_TRACE_SCOPE(TRACE_ENCODE, job.key.first);
+        int64_t start_us = wallClockUs();
+        std::shared_ptr<EncodedFrame> out = std::make_shared<EncodedFrame>();
+
+        // the left image is the right half of the raw frame; parts are views, the encoder reads the rows in place
+        const cv::Mat &raw = job.raw;
+        const EncodeParams &params = job.key.second;
+        int half = raw.cols / 2;
+        cv::Rect whole(0, 0, half, raw.rows);
+        cv::Rect roi = params.roi & whole;
+        if (roi.area() == 0) {
+            roi = whole;
+        }
+        cv::Mat left = raw(roi + cv::Point(half, 0));
+        cv::Mat right = raw(roi);
+        cv::Size size = params.size.area() > 0 ? params.size : roi.size();
+        uint8_t parts = params.parts;
+
+        size_t capacity = sizeof(FrameHeader);
+        capacity += (parts & FRAME_PART_LEFT) ? JpegEncoder::maxSize(size) : 0;
+        capacity += (parts & FRAME_PART_RIGHT) ? JpegEncoder::maxSize(size) : 0;
+        out->pool = pool_;
+        out->buffer = pool_->acquire(capacity);
+        uint8_t *dst = out->buffer.data() + sizeof(FrameHeader);
+        uint8_t *end = out->buffer.data() + out->buffer.size();
+        FrameHeader &hdr = out->header;
+        if (parts & FRAME_PART_LEFT) {
+            hdr.left_bytes = (uint32_t)jpeg.encode(fit(left, size, scaled), params.quality, dst, end - dst);
+            dst += hdr.left_bytes;
+        }
+        if (parts & FRAME_PART_RIGHT) {
+            hdr.right_bytes = (uint32_t)jpeg.encode(fit(right, size, scaled), params.quality, dst, end - dst);
+            dst += hdr.right_bytes;
+        }
+
+        hdr.parts = parts;
+        hdr.encoding = FRAME_ENCODING_JPEG;
+        hdr.seq = job.key.first;
+        hdr.capture_us = job.capture_us;
+        hdr.encode_us = (uint32_t)(wallClockUs() - start_us);
+        hdr.serial_number = serial_number_;
+        hdr.pos_number = pos_number_;
+        hdr.width = (uint16_t)size.width;
+        hdr.height = (uint16_t)size.height;
+        hdr.roi_x = (uint16_t)roi.x;
+        hdr.roi_y = (uint16_t)roi.y;
+        hdr.roi_width = (uint16_t)roi.width;
+        hdr.roi_height = (uint16_t)roi.height;
+        out->length = dst - out->buffer.data();
+        memcpy(out->buffer.data(), &hdr, sizeof(FrameHeader));
+        return out;
+    }
+};
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <zmq.hpp>
+
+// Binary messages between image_server and its clients.
+//
+// A client sends a FrameRequest naming the parts it wants (left, right or
+// both), optionally with a region of interest and a target size that the
+// server applies to every part before encoding; the server answers with a multipart message: a FrameHeader, then one
+// separately encoded image per requested part, left before right. A request
+// asking for no parts is answered with the header only, which measures the
+// bare REQ/REP round trip. The legacy "Hello" request is still answered with
+// a single bare JPEG of the left image.
+//
+// The PUB stream sends the same content as one message (header and parts
+// back to back) so subscribers can use ZMQ_CONFLATE. recvFrameMessage()
+// accepts both layouts. The depth and point cloud streams use the same single
+// message layout with the payload as the left part; depth frames add the
+// DepthIntrinsics of the camera's calibration as the right part when the
+// camera has one.
+//
+// On the credit endpoint (image_server --credit, ROUTER) DEALER clients send
+// FrameCredit messages instead of one request per frame: the server pushes
+// up to that many new frames in the multipart reply layout, without waiting.
+
+static const uint32_t kFrameRequestMagic = 0x51524355;  // "UCRQ"
+static const uint32_t kFrameHeaderMagic = 0x48464355;   // "UCFH"
+static const uint32_t kFrameCreditMagic = 0x52434355;   // "UCCR"
+static const uint8_t kFrameProtocolVersion = 3;
+
+enum FramePart : uint8_t {
+    FRAME_PART_NONE = 0,
+    FRAME_PART_LEFT = 1,
+    FRAME_PART_RIGHT = 2,
+    FRAME_PART_BOTH = FRAME_PART_LEFT | FRAME_PART_RIGHT,
+};
+
+enum FrameEncoding : uint8_t {
+    FRAME_ENCODING_NONE = 0,
+    FRAME_ENCODING_JPEG = 1,
+    FRAME_ENCODING_PNG16_DEPTH = 2,   // depth in millimetres, see depth_codec.hh
+    FRAME_ENCODING_POINT_CLOUD = 3,   // PointCloudCodec
+};
+
+// FrameHeader::flags of depth frames.
+enum FrameHeaderFlags : uint8_t {
+    FRAME_DEPTH_8BIT = 1,         // converted from 8 bit display depth, 256 levels over an assumed range
+    FRAME_DEPTH_RANGE_SET = 2,    // that range was configured (image_server --depth-range), not the default guess
+};
+
+#pragma pack(push, 1)
+struct FrameRequest {
+    uint32_t magic = kFrameRequestMagic;
+    uint8_t version = kFrameProtocolVersion;
+    uint8_t parts = FRAME_PART_LEFT;  // FramePart bits, 0 = header only
+    uint8_t quality = 0;              // JPEG quality, 0 = server default
+    uint8_t reserved = 0;
+    uint16_t roi_x = 0;               // region of interest in part pixels, 0 width or height = whole part
+    uint16_t roi_y = 0;
+    uint16_t roi_width = 0;
+    uint16_t roi_height = 0;
+    uint16_t width = 0;               // size the region is scaled to, 0 = unscaled
+    uint16_t height = 0;
+};
+
+// Grants the server `credits` more frames, encoded as `request` says (which
+// replaces the request of earlier grants). With FRAME_CREDIT_PROBE the server
+// also answers at once with a header only, to measure the round trip.
+enum FrameCreditFlags : uint8_t {
+    FRAME_CREDIT_PROBE = 1,
+};
+
+struct FrameCredit {
+    uint32_t magic = kFrameCreditMagic;
+    uint8_t version = kFrameProtocolVersion;
+    uint8_t flags = 0;                // FrameCreditFlags
+    uint16_t credits = 0;             // frames added to the client's window, may be 0
+    FrameRequest request;
+};
+
+struct FrameHeader {
+    uint32_t magic = kFrameHeaderMagic;
+    uint8_t version = kFrameProtocolVersion;
+    uint8_t parts = FRAME_PART_NONE;          // FramePart bits of the parts that follow
+    uint8_t encoding = FRAME_ENCODING_NONE;   // FrameEncoding of the parts
+    uint8_t flags = 0;                        // FrameHeaderFlags
+    uint64_t seq = 0;             // capture sequence number on the server
+    int64_t capture_us = 0;       // frame time stamp, microseconds since 1970-01-01
+    uint32_t encode_us = 0;       // time spent encoding the parts
+    uint32_t server_us = 0;       // time from request arrival to reply
+    uint32_t serial_number = 0;   // camera serial number
+    uint16_t pos_number = 0;      // camera position number
+    uint16_t width = 0;           // size of each encoded part in pixels
+    uint16_t height = 0;
+    uint16_t roi_x = 0;           // region of the part which was encoded, in part pixels
+    uint16_t roi_y = 0;
+    uint16_t roi_width = 0;
+    uint16_t roi_height = 0;
+    uint16_t reserved2 = 0;
+    uint32_t left_bytes = 0;      // encoded size of the left part, 0 if not sent
+    uint32_t right_bytes = 0;     // encoded size of the right part, 0 if not sent
+};
+
+// Pinhole intrinsics of a depth frame in its pixels: the rectified intrinsics (kfe) of the calibration.
+struct DepthIntrinsics {
+    float fx = 0;
+    float fy = 0;
+    float cx = 0;
+    float cy = 0;
+};
+#pragma pack(pop)
+
+inline int64_t wallClockUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Returns true and fills req if msg is a FrameRequest (as opposed to a legacy request).
+inline bool parseFrameRequest(const zmq::message_t &msg, FrameRequest &req)
+{
+    if (msg.size() < sizeof(FrameRequest)) {
+        return false;
+    }
+    memcpy(&req, msg.data(), sizeof(FrameRequest));
+    return req.magic == kFrameRequestMagic && req.version == kFrameProtocolVersion;
+}
+
+inline bool parseFrameCredit(const zmq::message_t &msg, FrameCredit &credit)
+{
+    if (msg.size() < sizeof(FrameCredit)) {
+        return false;
+    }
+    memcpy(&credit, msg.data(), sizeof(FrameCredit));
+    return credit.magic == kFrameCreditMagic && credit.version == kFrameProtocolVersion &&
+           credit.request.magic == kFrameRequestMagic;
+}
+
+inline bool parseFrameHeader(const zmq::message_t &msg, FrameHeader &hdr)
+{
+    if (msg.size() < sizeof(FrameHeader)) {
+        return false;
+    }
+    memcpy(&hdr, msg.data(), sizeof(FrameHeader));
+    return hdr.magic == kFrameHeaderMagic && hdr.version == kFrameProtocolVersion;
+}
+
+// A received frame: header plus pointers to the encoded parts, which live in msgs.
+struct FrameMessage {
+    FrameHeader header;
+    std::vector<zmq::message_t> msgs;
+    const uint8_t *left = nullptr;
+    const uint8_t *right = nullptr;
+};
+
+// Receives one frame from a REQ or SUB socket, multipart or single message.
+// Returns false on timeout or if the message is not a valid frame.
+inline bool recvFrameMessage(zmq::socket_t &socket, FrameMessage &frame)
+{
+    frame.msgs.clear();
+    frame.left = frame.right = nullptr;
+    do {
+        frame.msgs.emplace_back();
+        if (!socket.recv(frame.msgs.back())) {
+            return false;
+        }
+    } while (frame.msgs.back().more());
+    if (!parseFrameHeader(frame.msgs[0], frame.header)) {
+        return false;
+    }
+
+    const FrameHeader &hdr = frame.header;
+    std::vector<const uint8_t *> parts;  // start of every part, in order
+    if (frame.msgs.size() == 1) {
+        const uint8_t *p = static_cast<const uint8_t *>(frame.msgs[0].data()) + sizeof(FrameHeader);
+        if (frame.msgs[0].size() != sizeof(FrameHeader) + hdr.left_bytes + hdr.right_bytes) {
+            return false;
+        }
+        if (hdr.parts & FRAME_PART_LEFT) {
+            parts.push_back(p);
+            p += hdr.left_bytes;
+        }
+        if (hdr.parts & FRAME_PART_RIGHT) {
+            parts.push_back(p);
+        }
+    } else {
+        for (size_t i = 1; i < frame.msgs.size(); ++i) {
+            parts.push_back(static_cast<const uint8_t *>(frame.msgs[i].data()));
+        }
+    }
+
+    size_t expected = ((hdr.parts & FRAME_PART_LEFT) ? 1 : 0) + ((hdr.parts & FRAME_PART_RIGHT) ? 1 : 0);
+    if (parts.size() != expected) {
+        return false;
+    }
+    if (frame.msgs.size() > 1) {
+        // consumers read *_bytes from the part pointers, every part must be exactly that long
+        size_t i = 1;
+        if ((hdr.parts & FRAME_PART_LEFT) && frame.msgs[i++].size() != hdr.left_bytes) {
+            return false;
+        }
+        if ((hdr.parts & FRAME_PART_RIGHT) && frame.msgs[i].size() != hdr.right_bytes) {
+            return false;
+        }
+    }
+    size_t i = 0;
+    if (hdr.parts & FRAME_PART_LEFT) {
+        frame.left = parts[i++];
+    }
+    if (hdr.parts & FRAME_PART_RIGHT) {
+        frame.right = parts[i++];
+    }
+    return true;
+}
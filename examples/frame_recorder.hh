@@ -0,0 +1,329 @@
+#pragma once
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "frame_protocol.hh"
+
+// Passthrough recorder for the receivers.
+//
+// Writes received encoded bytes as they are (no decode, no re-encode) from a
+// bounded queue on a background thread, so a slow disk never stalls
+// reception. When the queue is full new frames are dropped and counted. The
+// writer takes everything queued at once: one file per frame, or with
+// append_path all frames back to back in one file (a valid MJPEG stream for
+// JPEG frames) with writev() batches and a text index of
+// "offset size name" lines next to it.
+
+enum class FsyncPolicy {
+    NEVER,        // leave it to the kernel
+    INTERVAL,     // flush to disk at most every fsync_interval_ms
+    EVERY_BATCH,  // flush after every batch, slow on small batches
+};
+
+struct RecorderOptions {
+    size_t max_frames = 64;            // queued frames before new ones are dropped
+    size_t max_bytes = 64 << 20;       // queued bytes before new ones are dropped
+    FsyncPolicy fsync = FsyncPolicy::INTERVAL;
+    int fsync_interval_ms = 1000;
+    std::string append_path;           // one file for everything instead of one file per frame
+};
+
+struct RecorderStats {
+    uint64_t written = 0;    // frames on disk
+    uint64_t dropped = 0;    // frames refused because the queue was full
+    uint64_t errors = 0;     // frames lost to write errors
+    uint64_t bytes = 0;
+    uint64_t batches = 0;
+    uint64_t fsyncs = 0;
+    size_t max_queue = 0;    // deepest queue seen, in frames
+};
+
+class FrameRecorder {
+public:
+    explicit FrameRecorder(const RecorderOptions &opt = RecorderOptions()) : opt_(opt)
+    {
+        if (!opt_.append_path.empty()) {
+            fd_ = ::open(opt_.append_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            index_fd_ = ::open((opt_.append_path + ".idx").c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (fd_ < 0 || index_fd_ < 0) {
+                perror(opt_.append_path.c_str());
+            } else {
+                offset_ = (uint64_t)::lseek(fd_, 0, SEEK_END);
+            }
+        }
+        writer_ = std::thread(&FrameRecorder::run, this);
+    }
+
+    // Writes what is still queued, then stops.
+    ~FrameRecorder()
+    {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            running_ = false;
+        }
+        cond_.notify_one();
+        writer_.join();
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+        if (index_fd_ >= 0) {
+            ::close(index_fd_);
+        }
+    }
+
+    // Queues [data, data + size) for path; owner keeps the bytes alive until they are written.
+    // Returns false if the frame was dropped.
+    bool write(std::string path, const uint8_t *data, size_t size, std::shared_ptr<const void> owner)
+    {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            if (!running_ || queue_.size() >= opt_.max_frames || queued_bytes_ + size > opt_.max_bytes) {
+                stats_.dropped++;
+                return false;
+            }
+            queue_.push_back({std::move(path), data, size, std::move(owner)});
+            queued_bytes_ += size;
+            stats_.max_queue = std::max(stats_.max_queue, queue_.size());
+        }
+        cond_.notify_one();
+        return true;
+    }
+
+    // Copying variant of write().
+    bool write(std::string path, const uint8_t *data, size_t size)
+    {
+        auto copy = std::make_shared<std::vector<uint8_t>>(data, data + size);
+        return write(std::move(path), copy->data(), size, copy);
+    }
+
+    RecorderStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        return stats_;
+    }
+
+    void printStats(FILE *fp = stdout) const
+    {
+        RecorderStats s = stats();
+        fprintf(fp, "recorder: written %llu (%.1f MB, %llu batches, %llu fsyncs), dropped %llu, errors %llu, max queue %zu\n",
+                (unsigned long long)s.written, s.bytes / 1e6, (unsigned long long)s.batches,
+                (unsigned long long)s.fsyncs, (unsigned long long)s.dropped, (unsigned long long)s.errors, s.max_queue);
+    }
+
+private:
+    struct Item {
+        std::string path;
+        const uint8_t *data;
+        size_t size;
+        std::shared_ptr<const void> owner;
+    };
+
+    RecorderOptions opt_;
+    int fd_ = -1;        // append mode
+    int index_fd_ = -1;
+    uint64_t offset_ = 0;
+    std::vector<std::string> unsynced_;  // file mode: frames written since the last flush
+    std::deque<Item> queue_;
+    size_t queued_bytes_ = 0;
+    RecorderStats stats_;
+    mutable std::mutex lock_;
+    std::condition_variable cond_;
+    bool running_ = true;
+    std::thread writer_;
+
+    static bool writeAll(int fd, const uint8_t *data, size_t size)
+    {
+        while (size > 0) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            data += n;
+            size -= (size_t)n;
+        }
+        return true;
+    }
+
+    // Writes the whole iovec array, resuming after partial writes.
+    static bool writevAll(int fd, iovec *iov, int count)
+    {
+        while (count > 0) {
+            ssize_t n = ::writev(fd, iov, std::min(count, IOV_MAX));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            while (count > 0 && (size_t)n >= iov->iov_len) {
+                n -= iov->iov_len;
+                ++iov;
+                --count;
+            }
+            if (count > 0) {
+                iov->iov_base = static_cast<uint8_t *>(iov->iov_base) + n;
+                iov->iov_len -= (size_t)n;
+            }
+        }
+        return true;
+    }
+
+    void run()
+    {
+        auto lastSync = std::chrono::steady_clock::now();
+        std::deque<Item> batch;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(lock_);
+                cond_.wait(lock, [this] { return !running_ || !queue_.empty(); });
+                if (queue_.empty()) {
+                    break;
+                }
+                batch.swap(queue_);
+                queued_bytes_ = 0;
+            }
+
+            bool sync = opt_.fsync == FsyncPolicy::EVERY_BATCH;
+            if (opt_.fsync == FsyncPolicy::INTERVAL &&
+                std::chrono::steady_clock::now() - lastSync >= std::chrono::milliseconds(opt_.fsync_interval_ms)) {
+                sync = true;
+            }
+            uint64_t written = 0, bytes = 0;
+            bool synced = opt_.append_path.empty() ? writeFiles(batch, sync, written, bytes)
+                                                   : writeAppend(batch, sync, written, bytes);
+            if (synced) {
+                lastSync = std::chrono::steady_clock::now();
+            }
+            {
+                std::lock_guard<std::mutex> lock(lock_);
+                stats_.written += written;
+                stats_.errors += batch.size() - written;
+                stats_.bytes += bytes;
+                stats_.batches++;
+                stats_.fsyncs += synced ? 1 : 0;
+            }
+            batch.clear();  // releases the owners
+        }
+        if (opt_.fsync != FsyncPolicy::NEVER) {  // the last batches may be inside the interval
+            if (fd_ >= 0 && index_fd_ >= 0) {
+                ::fdatasync(fd_);
+                ::fdatasync(index_fd_);
+            } else if (opt_.append_path.empty()) {
+                syncFiles();
+            }
+        }
+    }
+
+    // One file per frame. Returns true if the batch was flushed to disk.
+    bool writeFiles(const std::deque<Item> &batch, bool sync, uint64_t &written, uint64_t &bytes)
+    {
+        for (const Item &item : batch) {
+            int fd = ::open(item.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                perror(item.path.c_str());
+                continue;
+            }
+            if (writeAll(fd, item.data, item.size)) {
+                written++;
+                bytes += item.size;
+                unsynced_.push_back(item.path);
+            }
+            ::close(fd);
+        }
+        return sync && syncFiles();
+    }
+
+    // Flushes the frames written since the last flush, then their directories (the new entries).
+    // Only the recorder's own files, unlike sync()/syncfs() which write back the whole system or disk.
+    bool syncFiles()
+    {
+        bool ok = true;
+        std::vector<std::string> dirs;
+        for (const std::string &path : unsynced_) {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0 || ::fdatasync(fd) != 0) {
+                ok = false;
+            }
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            size_t slash = path.rfind('/');
+            std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+            if (std::find(dirs.begin(), dirs.end(), dir) == dirs.end()) {
+                dirs.push_back(dir);
+            }
+        }
+        for (const std::string &dir : dirs) {
+            int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd < 0 || ::fsync(fd) != 0) {
+                ok = false;
+            }
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+        unsynced_.clear();
+        return ok;
+    }
+
+    // Everything appended to one file with writev(), then the index lines.
+    bool writeAppend(const std::deque<Item> &batch, bool sync, uint64_t &written, uint64_t &bytes)
+    {
+        if (fd_ < 0 || index_fd_ < 0) {
+            return false;
+        }
+        std::vector<iovec> iov;
+        iov.reserve(batch.size());
+        std::string index;
+        uint64_t size = 0;
+        for (const Item &item : batch) {
+            iov.push_back({const_cast<uint8_t *>(item.data), item.size});
+            index += std::to_string(offset_ + size) + " " + std::to_string(item.size) + " " + item.path + "\n";
+            size += item.size;
+        }
+        if (!writevAll(fd_, iov.data(), (int)iov.size())) {
+            // the file position is unknown after a failed write, continue from the end
+            perror(opt_.append_path.c_str());
+            offset_ = (uint64_t)::lseek(fd_, 0, SEEK_END);
+            return false;
+        }
+        offset_ += size;
+        written = batch.size();
+        bytes = size;
+        writeAll(index_fd_, reinterpret_cast<const uint8_t *>(index.data()), index.size());
+        return sync && ::fdatasync(fd_) == 0 && ::fdatasync(index_fd_) == 0;
+    }
+};
+
+// Records the encoded parts of a received frame as base + ".jpg", or
+// base + "_left.jpg" / "_right.jpg" if it has both. The frame is moved into
+// the recorder, its parts are written without a copy.
+inline void recordFrame(FrameRecorder &recorder, FrameMessage &&frame, const std::string &base)
+{
+    auto owner = std::make_shared<FrameMessage>(std::move(frame));  // the part pointers stay valid
+    const FrameHeader &hdr = owner->header;
+    bool both = owner->left != nullptr && owner->right != nullptr;
+    if (owner->left != nullptr) {
+        recorder.write(base + (both ? "_left.jpg" : ".jpg"), owner->left, hdr.left_bytes, owner);
+    }
+    if (owner->right != nullptr) {
+        recorder.write(base + (both ? "_right.jpg" : ".jpg"), owner->right, hdr.right_bytes, owner);
+    }
+}
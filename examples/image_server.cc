@@ -8,71 +8,318 @@
   * @copyright Copyright (c) 2020-2021, Hangzhou Yushu Technology Stock CO.LTD. All Rights Reserved.
   */
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <UnitreeCameraSDK.hpp>
+#include <PipelineTrace.hpp>
+#include <SystemLogMacros.hpp>
 #include <opencv2/core/core.hpp>
 #include <unistd.h>
+#include <signal.h>
 #include <zmq.hpp>
+#include "credit_server.hh"
+#include "depth_streamer.hh"
+#include "frame_encoder.hh"
+#include "frame_protocol.hh"
+#include "synthetic_camera.hh"
 
-int main(int argc, char *argv[]){
-    zmq::context_t context(1);
-    zmq::socket_t socket(context, ZMQ_REP);
-    socket.bind("tcp://*:25661");
+static std::atomic<bool> g_traceToggle{false};
 
-    int deviceNode = 1; // default 0 -> /dev/video0
-    cv::Size frameSize(1856, 800); // defalut image size: 1856 X 800
+/// SIGUSR1 starts a 10 seconds pipeline trace, or stops a running one early. The signal is blocked in
+/// every thread (see main) and taken here with sigwait, so it never interrupts a blocking zmq call:
+/// libzmq does not restart them and cppzmq would throw zmq::error_t for the EINTR.
+static void blockTraceSignal(){
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &set, nullptr);
+}
+
+static void waitTraceSignals(){
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    int sig;
+    while(sigwait(&set, &sig) == 0)
+        g_traceToggle = true;
+}
+
+struct ServerOptions {
+    int deviceNode = 1;               // default 0 -> /dev/video0
+    cv::Size frameSize{1856, 800};    // defalut image size: 1856 X 800
     int fps = 30;
-    
-    if(argc >= 2){
-        deviceNode = std::atoi(argv[1]);
-        if(argc >= 4){
-            frameSize = cv::Size(std::atoi(argv[2]), std::atoi(argv[3]));
+    int quality = 92;                 // default JPEG quality
+    int port = 25661;
+    bool synthetic = false;           // use SyntheticCamera instead of the stereo camera
+    std::string replay;               // replay a recorded raw video / image with SyntheticCamera
+    bool stream = false;              // publish every new frame on a PUB socket
+    int streamPort = 25662;
+    int streamHwm = 2;                // frames queued per subscriber before new ones are dropped
+    uint8_t streamParts = FRAME_PART_LEFT; // FramePart bits published on the stream
+    cv::Rect streamRoi;               // region of every part published on the stream, empty = whole part
+    cv::Size streamSize;              // size the stream region is scaled to, empty = unscaled
+    int encoders = 2;                 // encoder pool threads
+    bool credit = false;              // push frames to DEALER clients as far as their credits reach
+    int creditPort = 25665;
+    DepthStreamOptions depth;         // depth and point cloud endpoints
+};
+
+/// usage: image_server [--synthetic] [--replay file] [--quality q] [--port p]
+///                     [--stream] [--stream-port p] [--stream-hwm n] [--stream-parts left|right|both]
+///                     [--stream-roi x,y,w,h] [--stream-size wxh] [--encoders n] [--credit] [--credit-port p]
+///                     [--depth] [--depth-port p] [--depth-range min,max] [--cloud] [--cloud-port p]
+///                     [deviceNode [width height [fps]]]
+static ServerOptions parseOptions(int argc, char *argv[]){
+    ServerOptions opt;
+    std::vector<char*> positional;
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if(arg == "--synthetic"){
+            opt.synthetic = true;
+        }else if(arg == "--replay" && i + 1 < argc){
+            opt.replay = argv[++i];
+        }else if(arg == "--quality" && i + 1 < argc){
+            opt.quality = std::atoi(argv[++i]);
+        }else if(arg == "--port" && i + 1 < argc){
+            opt.port = std::atoi(argv[++i]);
+        }else if(arg == "--stream"){
+            opt.stream = true;
+        }else if(arg == "--stream-port" && i + 1 < argc){
+            opt.streamPort = std::atoi(argv[++i]);
+        }else if(arg == "--stream-hwm" && i + 1 < argc){
+            opt.streamHwm = std::atoi(argv[++i]);
+        }else if(arg == "--stream-parts" && i + 1 < argc){
+            std::string parts = argv[++i];
+            opt.streamParts = parts == "both" ? FRAME_PART_BOTH : parts == "right" ? FRAME_PART_RIGHT : FRAME_PART_LEFT;
+        }else if(arg == "--stream-roi" && i + 1 < argc){
+            cv::Rect &r = opt.streamRoi;
+            if(sscanf(argv[++i], "%d,%d,%d,%d", &r.x, &r.y, &r.width, &r.height) != 4)
+                r = cv::Rect();
+        }else if(arg == "--stream-size" && i + 1 < argc){
+            cv::Size &sz = opt.streamSize;
+            if(sscanf(argv[++i], "%dx%d", &sz.width, &sz.height) != 2)
+                sz = cv::Size();
+        }else if(arg == "--encoders" && i + 1 < argc){
+            opt.encoders = std::atoi(argv[++i]);
+        }else if(arg == "--credit"){
+            opt.credit = true;
+        }else if(arg == "--credit-port" && i + 1 < argc){
+            opt.creditPort = std::atoi(argv[++i]);
+        }else if(arg == "--depth"){
+            opt.depth.depth = true;
+        }else if(arg == "--depth-port" && i + 1 < argc){
+            opt.depth.depthPort = std::atoi(argv[++i]);
+        }else if(arg == "--depth-range" && i + 1 < argc){ ///< millimetres of gray levels 0 and 255 of the 8 bit depth
+            int minMm, maxMm;
+            if(sscanf(argv[++i], "%d,%d", &minMm, &maxMm) == 2 && 0 <= minMm && minMm < maxMm && maxMm <= 65535){
+                opt.depth.grayMinMm = minMm;
+                opt.depth.grayMaxMm = maxMm;
+                opt.depth.grayRangeSet = true;
+            }
+        }else if(arg == "--cloud"){
+            opt.depth.cloud = true;
+        }else if(arg == "--cloud-port" && i + 1 < argc){
+            opt.depth.cloudPort = std::atoi(argv[++i]);
+        }else{
+            positional.push_back(argv[i]);
         }
-        if(argc >=5)
-            fps = std::atoi(argv[4]);
     }
-    
-    UnitreeCamera cam(deviceNode);  ///< init camera by device node number
+    if(positional.size() >= 1)
+        opt.deviceNode = std::atoi(positional[0]);
+    if(positional.size() >= 3)
+        opt.frameSize = cv::Size(std::atoi(positional[1]), std::atoi(positional[2]));
+    if(positional.size() >= 4)
+        opt.fps = std::atoi(positional[3]);
+    return opt;
+}
+
+template<typename Camera>
+static int serve(Camera &cam, const ServerOptions &opt){
+    zmq::context_t context(1);
+    zmq::socket_t socket(context, ZMQ_REP);
+    socket.bind("tcp://*:" + std::to_string(opt.port));
+
+    /// streaming mode: one single part message (FrameHeader + JPEG) per captured frame, so subscribers
+    /// can set ZMQ_CONFLATE to only keep the latest frame. Slow subscribers drop frames at the high-water mark.
+    zmq::socket_t publisher(context, ZMQ_PUB);
+    if(opt.stream){
+        publisher.set(zmq::sockopt::sndhwm, opt.streamHwm);
+        publisher.bind("tcp://*:" + std::to_string(opt.streamPort));
+    }
+
     if(!cam.isOpened())
         exit(EXIT_FAILURE);
     
-    cam.setRawFrameSize(frameSize); ///< set camera frame size
-    cam.setRawFrameRate(fps);       ///< set camera frame rate
+    cam.setRawFrameSize(opt.frameSize); ///< set camera frame size
+    cam.setRawFrameRate(opt.fps);       ///< set camera frame rate
     
     std::cout << "Device Position Number:" << cam.getPosNumber() << std::endl;
     
     cam.startCapture();            ///< start camera capturing
+    if(opt.depth.enabled())
+        cam.startStereoCompute();  ///< start disparity computing for the depth and point cloud endpoints
+
+    /// depth and point cloud endpoints publish from their own thread
+    DepthStreamer<Camera> depthStreamer(context, cam, opt.depth);
+
+    SystemLog log("ImageServer");
+    log.setLogLevel(2);            ///< per request messages are filtered by the application module level
+    if(getenv("IMAGE_SERVER_DEBUG") != nullptr)
+        LogModuleLevels::setLevel(LOG_MODULE_APPLICATION, 2);
+
+    PipelineTracer &tracer = PipelineTracer::instance();
+    tracer.setThreadName("image_server main");
+    std::thread(waitTraceSignals).detach();
+    uint64_t frameId = 0;
+
+    /// every captured frame is encoded once per EncodeParams on the encoder pool, clients share the result
+    FrameEncoder encoder(opt.encoders, 4);
+    encoder.setCamera(cam.getPosNumber(), cam.getSerialNumber());
+    EncodeParams streamParams;
+    streamParams.quality = opt.quality;
+    streamParams.parts = opt.streamParts;
+    streamParams.roi = opt.streamRoi;
+    streamParams.size = opt.streamSize;
+    std::deque<std::shared_future<EncodedFramePtr> > pendingPublish; ///< at most one frame per encoder thread
+    const size_t maxPendingPublish = opt.encoders > 0 ? opt.encoders : 1;
+    uint64_t publishedSeq = 0;
+    uint64_t publishDropped = 0;
+
+    /// credit endpoint: DEALER clients get frames pushed without a request per frame
+    std::unique_ptr<CreditServer> creditServer;
+    if(opt.credit)
+        creditServer.reset(new CreditServer(context, opt.creditPort, encoder, opt.quality));
+
+    cv::Mat frame;
+    std::chrono::microseconds lastStamp(0);
+    uint64_t captureSeq = 0;
+    auto pollCamera = [&](){ ///< return true if a new frame is captured, it is handed to the stream and credit clients
+        PIPELINE_TRACE_SCOPE(TRACE_CAPTURE, frameId);
+        cv::Mat latest;
+        std::chrono::microseconds t;
+        if(!cam.getRawFrame(latest, t) || t == lastStamp) ///< get camera raw image
+            return false;
+        frame = latest;
+        lastStamp = t;
+        captureSeq++;
+        if(opt.stream){
+            if(pendingPublish.size() >= maxPendingPublish){ ///< encoders fall behind: drop the oldest unfinished frame
+                auto oldest = std::find_if(pendingPublish.begin(), pendingPublish.end(), [](const std::shared_future<EncodedFramePtr> &f){
+                    return f.wait_for(std::chrono::seconds(0)) != std::future_status::ready; });
+                pendingPublish.erase(oldest != pendingPublish.end() ? oldest : pendingPublish.begin());
+                publishDropped++;
+                SYSLOG_RUNTIME_WARNING_LIMITED(log, LOG_MODULE_APPLICATION, 1, 1, "encoders behind, %llu stream frames dropped\n",
+                                               (unsigned long long)publishDropped);
+            }
+            pendingPublish.push_back(encoder.submit(captureSeq, lastStamp.count(), frame, streamParams));
+        }
+        if(creditServer)
+            creditServer->onFrame(captureSeq, lastStamp.count(), frame);
+        return true;
+    };
 
     while(cam.isOpened())
     {
-        std::cout << "waiting request" << std::endl;
-        zmq::message_t request, reply;
+        if(g_traceToggle || tracer.windowElapsed()){ ///< windowElapsed() is only true while tracing
+            g_traceToggle = false;
+            if(tracer.isEnabled()){
+                tracer.stop();
+                tracer.flush("image_server_trace.json");
+                std::cout << "pipeline trace saved to image_server_trace.json" << std::endl;
+            }else{
+                tracer.start(std::chrono::seconds(10));
+                std::cout << "pipeline trace started" << std::endl;
+            }
+        }
+
+        if(opt.stream || opt.credit){
+            if(pollCamera())
+                frameId++;
+            /// publish encoded frames in capture order, the header is already in front of the parts
+            while(!pendingPublish.empty() &&
+                  pendingPublish.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready){
+                EncodedFramePtr encoded = pendingPublish.front().get();
+                pendingPublish.pop_front();
+                if(!encoded || encoded->header.seq <= publishedSeq) ///< dropped by the encoder, or replaced by a newer frame
+                    continue;
+                publishedSeq = encoded->header.seq;
+                PIPELINE_TRACE_SCOPE("zmq_publish", encoded->header.seq);
+                zmq::message_t msg = makeSharedMessage(encoded, encoded->data(), encoded->size());
+                publisher.send(msg, zmq::send_flags::dontwait);
+            }
+
+            bool encoding = !pendingPublish.empty();
+            if(creditServer){
+                creditServer->receive();
+                encoding = creditServer->flush() || encoding;
+            }
+
+            /// serve REQ clients and credit grants between frames
+            zmq::pollitem_t items[] = {{socket.handle(), 0, ZMQ_POLLIN, 0},
+                                       {creditServer ? creditServer->socket().handle() : nullptr, 0, ZMQ_POLLIN, 0}};
+            zmq::poll(items, creditServer ? 2 : 1, std::chrono::milliseconds(encoding ? 1 : 2));
+            if(!(items[0].revents & ZMQ_POLLIN))
+                continue;
+        }
+
+        SYSLOG_DEBUG_INFO(log, LOG_MODULE_APPLICATION, "waiting request\n");
+        zmq::message_t request;
         (void)socket.recv(&request);
+        int64_t requestUs = wallClockUs();
+        frameId++;
 
-        cv::Mat frame;
-        std::chrono::microseconds t;
-        if(!cam.getRawFrame(frame, t)){ ///< get camera raw image
-            usleep(1000);
+        FrameRequest frameReq;
+        bool framed = parseFrameRequest(request, frameReq);
+        if(framed && frameReq.parts == FRAME_PART_NONE){ ///< round trip probe, no capture and no encoding
+            FrameHeader hdr;
+            hdr.server_us = (uint32_t)(wallClockUs() - requestUs);
+            socket.send(zmq::buffer(&hdr, sizeof(hdr)));
             continue;
         }
- 
-        cv::Mat left;
-        //frame(cv::Rect(0, 0, frame.size().width/2, frame.size().height)).copyTo(right);
-        frame(cv::Rect(frame.size().width/2,0, frame.size().width/2, frame.size().height)).copyTo(left);
-
-        std::vector<uint8_t> buf;
-        std::vector<int> param(2);
-        param[0]=1; //CV_IMWRITE_JPEG_QUALITY;
-        param[1]=92;
-        cv::imencode(".jpg", left, buf, param);
-
-
-        reply.rebuild(buf.size());
-        memcpy(reply.data(), &buf[0], buf.size());
-        socket.send(reply, 0);
-        std::cout << "reply sent out" << std::endl;
+
+        while(!pollCamera() && frame.empty()){ ///< a REP socket must answer every request
+            SYSLOG_RUNTIME_WARNING_LIMITED(log, LOG_MODULE_APPLICATION, 1, 1, "failed to get camera raw frame\n");
+            usleep(1000);
+        }
+
+        EncodeParams params;              ///< legacy requests get the whole left image
+        params.quality = opt.quality;
+        if(framed)                        ///< crop and scale on the server, before encoding
+            params = encodeParams(frameReq, opt.quality);
+        EncodedFramePtr encoded;
+        {
+            PIPELINE_TRACE_SCOPE(TRACE_ENCODE, frameId);
+            while(!(encoded = encoder.get(captureSeq, lastStamp.count(), frame, params))) ///< dropped from a full encoder queue
+                pollCamera();
+        }
+
+        {
+            PIPELINE_TRACE_SCOPE("zmq_reply", frameId);
+            if(framed){ ///< header, then every requested part as its own message
+                sendEncodedFrame(socket, encoded, (uint32_t)(wallClockUs() - requestUs));
+            }else{
+                zmq::message_t reply = makeSharedMessage(encoded, encoded->left(), encoded->header.left_bytes);
+                socket.send(reply, zmq::send_flags::none);
+            }
+        }
+        SYSLOG_DEBUG_INFO(log, LOG_MODULE_APPLICATION, "reply sent out, %zu bytes\n", encoded->payloadSize());
     }
     
+    if(opt.depth.enabled())
+        cam.stopStereoCompute();  ///< stop disparity computing
     cam.stopCapture();  ///< stop camera capturing
     
     return 0;
 }
+
+int main(int argc, char *argv[]){
+    ServerOptions opt = parseOptions(argc, argv);
+    blockTraceSignal();  ///< before the camera, the encoders or zmq start threads, which inherit the mask
+    if(opt.synthetic || !opt.replay.empty()){
+        SyntheticCamera cam(opt.replay);
+        return serve(cam, opt);
+    }
+    UnitreeCamera cam(opt.deviceNode);  ///< init camera by device node number
+    return serve(cam, opt);
+}
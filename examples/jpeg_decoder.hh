@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#ifdef HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+#include "frame_protocol.hh"
+
+// JPEG decoder for the receivers. Decodes straight from the received message
+// memory into a caller owned cv::Mat which keeps its buffer across frames:
+// dst is only reallocated when the decoded size or type changes, and a
+// correctly sized view (e.g. one half of a side-by-side display image) is
+// decoded into in place. scale 2, 4 or 8 decodes at 1/scale size for
+// consumers which only need a small image, which is much cheaper than a full
+// decode and a resize. With TurboJPEG (HAVE_TURBOJPEG) tjDecompress2 is used,
+// otherwise cv::imdecode with the IMREAD_REDUCED_COLOR flags. One instance per
+// thread.
+class JpegDecoder {
+public:
+    JpegDecoder()
+    {
+#ifdef HAVE_TURBOJPEG
+        handle_ = tjInitDecompress();
+#endif
+    }
+
+    ~JpegDecoder()
+    {
+#ifdef HAVE_TURBOJPEG
+        if (handle_) {
+            tjDestroy(handle_);
+        }
+#endif
+    }
+
+    JpegDecoder(const JpegDecoder &) = delete;
+    JpegDecoder &operator=(const JpegDecoder &) = delete;
+
+    // Size of a size image decoded at 1/scale, rounded up like libjpeg does.
+    static cv::Size scaledSize(cv::Size size, int scale)
+    {
+        return cv::Size((size.width + scale - 1) / scale, (size.height + scale - 1) / scale);
+    }
+
+    // Decodes to BGR at 1/scale (1, 2, 4 or 8). Returns false if data is not a valid JPEG.
+    bool decode(const uint8_t *data, size_t size, cv::Mat &dst, int scale = 1)
+    {
+        if (data == nullptr || size == 0) {
+            return false;
+        }
+        if (scale != 2 && scale != 4 && scale != 8) {
+            scale = 1;
+        }
+#ifdef HAVE_TURBOJPEG
+        int width, height, subsamp, colorspace;
+        if (handle_ &&
+            tjDecompressHeader3(handle_, data, (unsigned long)size, &width, &height, &subsamp, &colorspace) == 0) {
+            cv::Size out = scaledSize(cv::Size(width, height), scale);
+            dst.create(out, CV_8UC3);
+            return tjDecompress2(handle_, data, (unsigned long)size, dst.ptr<uint8_t>(), out.width, (int)dst.step,
+                                 out.height, TJPF_BGR, TJFLAG_FASTDCT) == 0;
+        }
+#endif
+        int flags = scale == 8   ? cv::IMREAD_REDUCED_COLOR_8
+                    : scale == 4 ? cv::IMREAD_REDUCED_COLOR_4
+                    : scale == 2 ? cv::IMREAD_REDUCED_COLOR_2
+                                 : cv::IMREAD_COLOR;
+        return !cv::imdecode(cv::Mat(1, (int)size, CV_8U, const_cast<uint8_t *>(data)), flags, &dst).empty();
+    }
+
+    // Decodes into the region where of dst, which must have the decoded size.
+    bool decodeInto(const uint8_t *data, size_t size, cv::Mat &dst, const cv::Rect &where, int scale = 1)
+    {
+        cv::Mat view = dst(where);
+        return decode(data, size, view, scale) && view.data == dst.ptr(where.y, where.x);  // not reallocated
+    }
+
+    // Decodes the left or right part of a received frame.
+    bool decode(const FrameMessage &frame, FramePart part, cv::Mat &dst, int scale = 1)
+    {
+        if (part == FRAME_PART_RIGHT) {
+            return decode(frame.right, frame.header.right_bytes, dst, scale);
+        }
+        return decode(frame.left, frame.header.left_bytes, dst, scale);
+    }
+
+private:
+#ifdef HAVE_TURBOJPEG
+    tjhandle handle_ = nullptr;
+#endif
+};
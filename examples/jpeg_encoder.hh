@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#ifdef HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
+// Recycles encode buffers, so steady state encoding does not allocate.
+// Buffers are plain vectors kept at their full size; whoever acquires one
+// tracks how many bytes of it are in use. Requests take the smallest free
+// buffer that fits and leave the others, so mixed sizes (full frames next
+// to ROI or scaled ones) keep their buffers.
+class BufferPool {
+public:
+    explicit BufferPool(size_t max_free = 16) : max_free_(max_free) {}
+
+    // Returns a buffer of at least size bytes, allocated only if no free buffer is large enough.
+    std::vector<uint8_t> acquire(size_t size)
+    {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            size_t best = free_.size();
+            for (size_t i = 0; i < free_.size(); ++i) {
+                if (free_[i].size() >= size && (best == free_.size() || free_[i].size() < free_[best].size())) {
+                    best = i;
+                }
+            }
+            if (best < free_.size()) {
+                std::vector<uint8_t> buf = std::move(free_[best]);
+                free_[best] = std::move(free_.back());
+                free_.pop_back();
+                return buf;
+            }
+            allocations_++;
+        }
+        return std::vector<uint8_t>(size);
+    }
+
+    // A full pool keeps the larger buffers: buf replaces the smallest free one if it is larger.
+    void release(std::vector<uint8_t> &&buf)
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (buf.empty() || max_free_ == 0) {
+            return;
+        }
+        if (free_.size() < max_free_) {
+            free_.push_back(std::move(buf));
+            return;
+        }
+        size_t smallest = 0;
+        for (size_t i = 1; i < free_.size(); ++i) {
+            if (free_[i].size() < free_[smallest].size()) {
+                smallest = i;
+            }
+        }
+        if (buf.size() > free_[smallest].size()) {
+            free_[smallest] = std::move(buf);
+        }
+    }
+
+    uint64_t allocations() const
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        return allocations_;
+    }
+
+private:
+    size_t max_free_;
+    std::vector<std::vector<uint8_t>> free_;
+    mutable std::mutex lock_;
+    uint64_t allocations_ = 0;
+};
+
+// JPEG encoder writing into a caller provided buffer. With TurboJPEG
+// (HAVE_TURBOJPEG) it compresses straight from the source rows, so the source
+// may be an ROI view of a larger frame; otherwise cv::imencode is used and
+// its output is copied. One instance per thread.
+class JpegEncoder {
+public:
+    JpegEncoder()
+    {
+#ifdef HAVE_TURBOJPEG
+        handle_ = tjInitCompress();
+#endif
+    }
+
+    ~JpegEncoder()
+    {
+#ifdef HAVE_TURBOJPEG
+        if (handle_) {
+            tjDestroy(handle_);
+        }
+#endif
+    }
+
+    JpegEncoder(const JpegEncoder &) = delete;
+    JpegEncoder &operator=(const JpegEncoder &) = delete;
+
+    // Worst case encoded size of a BGR image of this size.
+    static size_t maxSize(cv::Size size)
+    {
+#ifdef HAVE_TURBOJPEG
+        return tjBufSize(size.width, size.height, TJSAMP_420);
+#else
+        return (size_t)size.width * size.height * 3 + 2048;
+#endif
+    }
+
+    // Encodes a BGR image into dst, returns the encoded size or 0 on failure
+    // (capacity should be maxSize(bgr.size())).
+    size_t encode(const cv::Mat &bgr, int quality, uint8_t *dst, size_t capacity)
+    {
+#ifdef HAVE_TURBOJPEG
+        if (handle_ && bgr.type() == CV_8UC3 && capacity >= maxSize(bgr.size())) {
+            unsigned char *out = dst;
+            unsigned long size = capacity;
+            if (tjCompress2(handle_, bgr.ptr<uint8_t>(), bgr.cols, (int)bgr.step, bgr.rows, TJPF_BGR, &out,
+                            &size, TJSAMP_420, quality, TJFLAG_NOREALLOC | TJFLAG_FASTDCT) == 0) {
+                return size;
+            }
+            return 0;
+        }
+#endif
+        std::vector<int> param = {cv::IMWRITE_JPEG_QUALITY, quality};
+        if (!cv::imencode(".jpg", bgr, fallback_, param) || fallback_.size() > capacity) {
+            return 0;
+        }
+        memcpy(dst, fallback_.data(), fallback_.size());
+        return fallback_.size();
+    }
+
+private:
+#ifdef HAVE_TURBOJPEG
+    tjhandle handle_ = nullptr;
+#endif
+    std::vector<uint8_t> fallback_;  // imencode output, its capacity is reused
+};
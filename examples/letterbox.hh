@@ -0,0 +1,217 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+
+// Network input preprocessing of ObjectDetector in one pass.
+//
+// Produces what cv::cvtColor(BGR2RGB), darknet's image conversion and
+// letterbox_image() did in three passes: the image scaled to fit the network
+// size with its aspect ratio kept (with the bilinear sampling of darknet's
+// resize_image()), centred on 0.5 gray, RGB, in [0, 1], as planar CHW floats.
+// Output goes straight into the caller's buffer (the network input).
+//
+// Each source row is converted once to scaled float planes (deinterleaved,
+// channels swapped), then sampled horizontally; the two rows an output row
+// needs are cached, so the vertical blend is a plain vector loop writing the
+// output planes. The geometry tables are only rebuilt when the input or
+// network size changes.
+class LetterboxPreprocessor {
+public:
+    // Writes net_w x net_h x 3 floats to dst for a CV_8UC3 BGR image.
+    void run(const cv::Mat &bgr, int net_w, int net_h, float *dst)
+    {
+        CV_Assert(bgr.type() == CV_8UC3 && !bgr.empty() && net_w > 0 && net_h > 0);
+        prepare(bgr.size(), net_w, net_h);
+        fillBorder(dst);
+
+        cached_[0] = cached_[1] = -1;
+        const int plane = net_w_ * net_h_;
+        for (int r = 0; r < new_h_; ++r) {
+            const float *a = horizontalRow(bgr, yofs_[r]);
+            bool last = r == new_h_ - 1 || src_.height == 1;  // darknet only blends in the next row before the last one
+            const float *b = last ? a : horizontalRow(bgr, yofs_[r] + 1);
+            float w0 = 1.0f - yw_[r], w1 = last ? 0.0f : yw_[r];
+            for (int k = 0; k < 3; ++k) {
+                blendRows(a + k * new_w_, b + k * new_w_, w0, w1, dst + k * plane + (top_ + r) * net_w_ + left_);
+            }
+        }
+    }
+
+    // Region of the network input the image was scaled into.
+    cv::Rect placement() const { return cv::Rect(left_, top_, new_w_, new_h_); }
+
+private:
+    cv::Size src_;
+    int net_w_ = 0, net_h_ = 0;
+    int new_w_ = 0, new_h_ = 0;          // scaled image size
+    int left_ = 0, top_ = 0;             // its offset in the network input
+    std::vector<int> x0_, x1_;           // per output column: source columns
+    std::vector<float> xw0_, xw1_;       // and their weights
+    std::vector<int> yofs_;              // per output row: first source row
+    std::vector<float> yw_;              // and the weight of the second one
+    std::vector<float> planes_;          // one source row as scaled R, G, B planes
+    std::vector<float> rows_[2];         // horizontally sampled rows, 3 planes of new_w_ each
+    int cached_[2] = {-1, -1};           // source row held by rows_[i]
+
+    void prepare(cv::Size src, int net_w, int net_h)
+    {
+        if (src == src_ && net_w == net_w_ && net_h == net_h_) {
+            return;
+        }
+        src_ = src;
+        net_w_ = net_w;
+        net_h_ = net_h;
+        // sizes and offsets exactly like letterbox_image()
+        if ((float)net_w / src.width < (float)net_h / src.height) {
+            new_w_ = net_w;
+            new_h_ = (src.height * net_w) / src.width;
+        } else {
+            new_h_ = net_h;
+            new_w_ = (src.width * net_h) / src.height;
+        }
+        new_w_ = std::max(new_w_, 1);
+        new_h_ = std::max(new_h_, 1);
+        left_ = (net_w - new_w_) / 2;
+        top_ = (net_h - new_h_) / 2;
+
+        // sample positions of resize_image(): corners map to corners, the last column is copied
+        float w_scale = new_w_ > 1 ? (float)(src.width - 1) / (new_w_ - 1) : 0.0f;
+        float h_scale = new_h_ > 1 ? (float)(src.height - 1) / (new_h_ - 1) : 0.0f;
+        x0_.resize(new_w_);
+        x1_.resize(new_w_);
+        xw0_.resize(new_w_);
+        xw1_.resize(new_w_);
+        for (int c = 0; c < new_w_; ++c) {
+            if (c == new_w_ - 1 || src.width == 1) {
+                x0_[c] = x1_[c] = src.width - 1;
+                xw0_[c] = 1.0f;
+                xw1_[c] = 0.0f;
+            } else {
+                float sx = c * w_scale;
+                int ix = (int)sx;
+                float dx = sx - ix;
+                x0_[c] = ix;
+                x1_[c] = std::min(ix + 1, src.width - 1);
+                xw0_[c] = 1.0f - dx;
+                xw1_[c] = dx;
+            }
+        }
+        yofs_.resize(new_h_);
+        yw_.resize(new_h_);
+        for (int r = 0; r < new_h_; ++r) {
+            float sy = r * h_scale;
+            int iy = (int)sy;
+            yofs_[r] = iy;
+            yw_[r] = sy - iy;
+        }
+        planes_.resize((size_t)src.width * 3);
+        rows_[0].resize((size_t)new_w_ * 3);
+        rows_[1].resize((size_t)new_w_ * 3);
+    }
+
+    void fillBorder(float *dst) const
+    {
+        const int plane = net_w_ * net_h_;
+        for (int k = 0; k < 3; ++k) {
+            float *p = dst + k * plane;
+            std::fill(p, p + top_ * net_w_, 0.5f);
+            std::fill(p + (top_ + new_h_) * net_w_, p + plane, 0.5f);
+            if (new_w_ == net_w_) {
+                continue;
+            }
+            for (int y = top_; y < top_ + new_h_; ++y) {
+                std::fill(p + y * net_w_, p + y * net_w_ + left_, 0.5f);
+                std::fill(p + y * net_w_ + left_ + new_w_, p + (y + 1) * net_w_, 0.5f);
+            }
+        }
+    }
+
+    // Source row y sampled to new_w_ columns, from the cache if possible.
+    const float *horizontalRow(const cv::Mat &bgr, int y)
+    {
+        for (int i = 0; i < 2; ++i) {
+            if (cached_[i] == y) {
+                return rows_[i].data();
+            }
+        }
+        // rows are visited top down, the smaller cached row is not needed again
+        int slot = cached_[0] < cached_[1] ? 0 : 1;
+        cached_[slot] = y;
+        convertRow(bgr.ptr<uint8_t>(y), src_.width, planes_.data());
+        for (int k = 0; k < 3; ++k) {
+            sampleRow(planes_.data() + k * src_.width, rows_[slot].data() + k * new_w_);
+        }
+        return rows_[slot].data();
+    }
+
+    // BGR pixels to R, G, B float planes in [0, 1].
+    static void convertRow(const uint8_t *src, int width, float *planes)
+    {
+        const float scale = 1.0f / 255.0f;
+        float *r = planes, *g = planes + width, *b = planes + 2 * width;
+        int x = 0;
+#if CV_SIMD128
+        const cv::v_float32x4 vscale = cv::v_setall_f32(scale);
+        for (; x + 16 <= width; x += 16) {
+            cv::v_uint8x16 vb, vg, vr;
+            cv::v_load_deinterleave(src + x * 3, vb, vg, vr);
+            storeScaled(vr, vscale, r + x);
+            storeScaled(vg, vscale, g + x);
+            storeScaled(vb, vscale, b + x);
+        }
+#endif
+        for (; x < width; ++x) {
+            b[x] = src[x * 3] * scale;
+            g[x] = src[x * 3 + 1] * scale;
+            r[x] = src[x * 3 + 2] * scale;
+        }
+    }
+
+#if CV_SIMD128
+    static void storeScaled(const cv::v_uint8x16 &v, const cv::v_float32x4 &scale, float *dst)
+    {
+        cv::v_uint16x8 lo, hi;
+        cv::v_expand(v, lo, hi);
+        cv::v_uint32x4 q0, q1, q2, q3;
+        cv::v_expand(lo, q0, q1);
+        cv::v_expand(hi, q2, q3);
+        cv::v_store(dst, cv::v_cvt_f32(cv::v_reinterpret_as_s32(q0)) * scale);
+        cv::v_store(dst + 4, cv::v_cvt_f32(cv::v_reinterpret_as_s32(q1)) * scale);
+        cv::v_store(dst + 8, cv::v_cvt_f32(cv::v_reinterpret_as_s32(q2)) * scale);
+        cv::v_store(dst + 12, cv::v_cvt_f32(cv::v_reinterpret_as_s32(q3)) * scale);
+    }
+#endif
+
+    void sampleRow(const float *src, float *dst) const
+    {
+        int c = 0;
+#if CV_SIMD128
+        for (; c + 4 <= new_w_; c += 4) {
+            cv::v_float32x4 a = cv::v_lut(src, x0_.data() + c);
+            cv::v_float32x4 b = cv::v_lut(src, x1_.data() + c);
+            cv::v_store(dst + c, a * cv::v_load(xw0_.data() + c) + b * cv::v_load(xw1_.data() + c));
+        }
+#endif
+        for (; c < new_w_; ++c) {
+            dst[c] = xw0_[c] * src[x0_[c]] + xw1_[c] * src[x1_[c]];
+        }
+    }
+
+    void blendRows(const float *a, const float *b, float w0, float w1, float *dst) const
+    {
+        int c = 0;
+#if CV_SIMD128
+        const cv::v_float32x4 v0 = cv::v_setall_f32(w0), v1 = cv::v_setall_f32(w1);
+        for (; c + 4 <= new_w_; c += 4) {
+            cv::v_store(dst + c, cv::v_load(a + c) * v0 + cv::v_load(b + c) * v1);
+        }
+#endif
+        for (; c < new_w_; ++c) {
+            dst[c] = w0 * a[c] + w1 * b[c];
+        }
+    }
+};
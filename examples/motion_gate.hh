@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+
+// Cheap change detector in front of the object detector.
+//
+// Each frame is shrunk to `width` pixels wide and converted to gray, then
+// compared block by block with the frame of the last inference (accept()):
+// a block whose mean absolute difference exceeds `threshold` gray levels has
+// changed. changed() is false when fewer than min_blocks blocks changed, and
+// the caller re-emits its previous detections instead of running the network.
+// Comparing with the last inferred frame rather than the previous one lets
+// slow motion add up until it counts. After max_skip skipped frames in a row
+// inference is forced anyway, so lighting drift cannot freeze the output.
+// The shrunk images are reused, changed() does not allocate once running.
+
+struct MotionGateOptions {
+    int width = 160;                // of the compared images, height keeps the aspect ratio
+    int block = 8;                  // block size in compared pixels
+    float threshold = 8;            // mean absolute gray difference of a changed block
+    int min_blocks = 1;             // changed blocks needed to run inference
+    int max_skip = 30;              // skipped frames in a row before inference is forced
+};
+
+struct MotionGateStats {
+    uint64_t frames = 0;
+    uint64_t skipped = 0;           // frames inference was skipped on
+    uint64_t forced = 0;            // frames let through by max_skip only
+    double gate_us = 0;             // time spent in changed()
+    uint64_t inferences = 0;        // inference times reported by addInference()
+    double infer_us = 0;
+    double skipRate() const { return frames ? (double)skipped / frames : 0.0; }
+    // inference time saved by the skipped frames, at the mean reported inference time
+    double savedUs() const { return inferences ? skipped * infer_us / inferences : 0.0; }
+};
+
+class MotionGate {
+public:
+    explicit MotionGate(const MotionGateOptions &opt = MotionGateOptions()) : opt_(opt) {}
+
+    // Whether image differs enough from the last accepted frame to run inference on it.
+    bool changed(const cv::Mat &image)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        int height = std::max(1, image.rows * opt_.width / std::max(image.cols, 1));
+        cv::resize(image, small_, cv::Size(opt_.width, height), 0, 0, cv::INTER_AREA);
+        if (small_.channels() == 1) {
+            small_.copyTo(gray_);
+        } else {
+            cv::cvtColor(small_, gray_, cv::COLOR_BGR2GRAY);
+        }
+
+        bool result;
+        if (reference_.empty() || reference_.size() != gray_.size()) {
+            result = true;
+        } else if (changedBlocks() >= opt_.min_blocks) {
+            result = true;
+        } else if (skipped_ >= opt_.max_skip) {
+            result = true;
+            stats_.forced++;
+        } else {
+            result = false;
+        }
+
+        stats_.frames++;
+        if (!result) {
+            stats_.skipped++;
+            skipped_++;
+        }
+        stats_.gate_us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+        return result;
+    }
+
+    // The frame of the last changed() call went through inference; later frames are compared with it.
+    void accept()
+    {
+        std::swap(reference_, gray_);
+        skipped_ = 0;
+    }
+
+    // Inference time of an accepted frame, for MotionGateStats::savedUs().
+    void addInference(double us)
+    {
+        stats_.inferences++;
+        stats_.infer_us += us;
+    }
+
+    MotionGateStats stats() const { return stats_; }
+
+    void printStats(const char *name, FILE *fp = stdout) const
+    {
+        const MotionGateStats &s = stats_;
+        fprintf(fp, "motion gate %s: %llu frames, %.1f%% skipped (%llu forced), gate %.3f ms/frame, saved %.1f s of inference\n",
+                name, (unsigned long long)s.frames, s.skipRate() * 100, (unsigned long long)s.forced,
+                s.frames ? s.gate_us / s.frames / 1000.0 : 0.0, s.savedUs() / 1e6);
+    }
+
+private:
+    MotionGateOptions opt_;
+    MotionGateStats stats_;
+    cv::Mat small_, gray_, reference_;
+    int skipped_ = 0;
+
+    int changedBlocks() const
+    {
+        const int block = std::max(opt_.block, 1);
+        int changed = 0;
+        for (int by = 0; by < gray_.rows; by += block) {
+            int rows = std::min(block, gray_.rows - by);
+            for (int bx = 0; bx < gray_.cols; bx += block) {
+                int cols = std::min(block, gray_.cols - bx);
+                int sum = 0;
+                for (int y = by; y < by + rows; ++y) {
+                    const uint8_t *a = gray_.ptr<uint8_t>(y) + bx;
+                    const uint8_t *b = reference_.ptr<uint8_t>(y) + bx;
+                    for (int x = 0; x < cols; ++x) {
+                        sum += std::abs(a[x] - b[x]);
+                    }
+                }
+                if (sum > opt_.threshold * rows * cols) {
+                    changed++;
+                }
+            }
+        }
+        return changed;
+    }
+};
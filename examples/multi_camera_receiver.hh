@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <string>
+#include <vector>
+#include <zmq.hpp>
+#include "frame_protocol.hh"
+
+// Receives from N image servers at once and pairs their frames by capture
+// time stamp.
+//
+// Every source is either a REQ connection (one request always outstanding,
+// re-sent as soon as the reply arrives) or a SUB connection to a --stream
+// server. A REQ server answers with its cached frame until the camera
+// delivers a new one; such repeats (same seq as the last queued frame) are
+// counted as duplicates and dropped, and the next request to that source is
+// held back by half its frame period. All sockets are served by one zmq::poll loop, so sources never wait
+// for each other. Received frames queue per source; a bundle (one frame per
+// source) is emitted when all heads are within the tolerance of each other.
+// Frames which can no longer be matched are dropped and counted.
+
+struct FrameBundle {
+    std::vector<FrameMessage> frames;  // one per source, in addServer/addStream order
+    int64_t skew_us = 0;               // newest minus oldest capture time stamp
+};
+
+struct SyncStats {
+    uint64_t bundles = 0;
+    std::vector<uint64_t> received;    // per source
+    std::vector<uint64_t> unmatched;   // per source, dropped without a partner
+    std::vector<uint64_t> duplicates;  // per source, REQ replies repeating the last frame, not in received
+    uint64_t timeouts = 0;             // REQ requests given up and re-sent
+    double skew_sum_us = 0;
+    int64_t skew_max_us = 0;
+
+    double meanSkewUs() const { return bundles > 0 ? skew_sum_us / bundles : 0.0; }
+};
+
+class MultiCameraReceiver {
+public:
+    MultiCameraReceiver(zmq::context_t &context, int64_t tolerance_us, size_t max_queue = 4,
+                        std::chrono::milliseconds request_timeout = std::chrono::milliseconds(1000))
+        : context_(context), tolerance_us_(tolerance_us), max_queue_(max_queue > 0 ? max_queue : 1),
+          request_timeout_us_(request_timeout.count() * 1000)
+    {
+    }
+
+    // Requests frames from a REQ/REP server, e.g. "tcp://192.168.123.13:25661".
+    void addServer(const std::string &name, const std::string &endpoint, const FrameRequest &req = FrameRequest())
+    {
+        Source src;
+        src.name = name;
+        src.endpoint = endpoint;
+        src.request = req;
+        src.requesting = true;
+        sources_.push_back(std::move(src));
+        connect(sources_.back());
+        stats_.received.push_back(0);
+        stats_.unmatched.push_back(0);
+        stats_.duplicates.push_back(0);
+    }
+
+    // Subscribes to the stream of a --stream server, e.g. "tcp://192.168.123.13:25662".
+    void addStream(const std::string &name, const std::string &endpoint)
+    {
+        Source src;
+        src.name = name;
+        src.endpoint = endpoint;
+        sources_.push_back(std::move(src));
+        connect(sources_.back());
+        stats_.received.push_back(0);
+        stats_.unmatched.push_back(0);
+        stats_.duplicates.push_back(0);
+    }
+
+    size_t size() const { return sources_.size(); }
+    const std::string &name(size_t i) const { return sources_[i].name; }
+    const SyncStats &stats() const { return stats_; }
+
+    // Serves all sources until a bundle is ready or timeout elapses. Returns true with a bundle.
+    bool poll(FrameBundle &bundle, std::chrono::milliseconds timeout)
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (true) {
+            if (match(bundle)) {
+                return true;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline) {
+                return false;
+            }
+            std::vector<zmq::pollitem_t> items;
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now);
+            wait = std::min(wait, std::chrono::milliseconds(100));
+            int64_t now_us = wallClockUs();
+            for (Source &src : sources_) {
+                items.push_back({src.socket.handle(), 0, ZMQ_POLLIN, 0});
+                if (src.requesting && !src.in_flight) {
+                    wait = std::min(wait, std::chrono::milliseconds(std::max<int64_t>(0, (src.next_us - now_us) / 1000)));
+                }
+            }
+            zmq::poll(items.data(), items.size(), wait);
+
+            now_us = wallClockUs();
+            for (size_t i = 0; i < sources_.size(); ++i) {
+                Source &src = sources_[i];
+                if (items[i].revents & ZMQ_POLLIN) {
+                    receive(i);
+                } else if (src.requesting && !src.in_flight) {
+                    if (now_us >= src.next_us) {
+                        sendRequest(src);
+                    }
+                } else if (src.requesting && now_us - src.sent_us > request_timeout_us_) {
+                    // a REQ socket can not send again before the reply, start over with a new one
+                    stats_.timeouts++;
+                    connect(src);
+                }
+            }
+        }
+    }
+
+    void printStats(FILE *fp = stdout) const
+    {
+        fprintf(fp, "bundles %llu, skew mean %.2f ms max %.2f ms, timeouts %llu\n", (unsigned long long)stats_.bundles,
+                stats_.meanSkewUs() / 1000.0, stats_.skew_max_us / 1000.0, (unsigned long long)stats_.timeouts);
+        for (size_t i = 0; i < sources_.size(); ++i) {
+            fprintf(fp, "  %s: received %llu, unmatched %llu, duplicates %llu\n", sources_[i].name.c_str(),
+                    (unsigned long long)stats_.received[i], (unsigned long long)stats_.unmatched[i],
+                    (unsigned long long)stats_.duplicates[i]);
+        }
+    }
+
+private:
+    struct Source {
+        std::string name;
+        std::string endpoint;
+        FrameRequest request;
+        bool requesting = false;  // REQ source, otherwise SUB
+        zmq::socket_t socket;
+        int64_t sent_us = 0;
+        bool in_flight = false;   // REQ: a request waits for its reply
+        int64_t next_us = 0;      // REQ: earliest time of the next request
+        bool queued_any = false;
+        uint64_t last_seq = 0;    // of the last queued frame
+        int64_t last_capture_us = 0;
+        int64_t period_us = 0;    // capture interval of the last two distinct frames
+        std::deque<FrameMessage> queue;
+    };
+
+    zmq::context_t &context_;
+    int64_t tolerance_us_;
+    size_t max_queue_;
+    int64_t request_timeout_us_;
+    std::vector<Source> sources_;
+    SyncStats stats_;
+
+    void connect(Source &src)
+    {
+        src.socket = zmq::socket_t(context_, src.requesting ? ZMQ_REQ : ZMQ_SUB);
+        src.socket.set(zmq::sockopt::linger, 0);
+        if (!src.requesting) {
+            src.socket.set(zmq::sockopt::subscribe, "");
+        }
+        src.socket.connect(src.endpoint);
+        if (src.requesting) {
+            sendRequest(src);
+        }
+    }
+
+    void sendRequest(Source &src)
+    {
+        src.socket.send(zmq::buffer(&src.request, sizeof(src.request)));
+        src.sent_us = wallClockUs();
+        src.in_flight = true;
+    }
+
+    void receive(size_t i)
+    {
+        Source &src = sources_[i];
+        FrameMessage frame;
+        bool ok = recvFrameMessage(src.socket, frame);
+        bool duplicate = ok && src.queued_any && frame.header.seq == src.last_seq;
+        if (src.requesting) {
+            // keep one request in flight while the frame waits for its partners, unless the server has
+            // nothing new yet: then give the camera half a frame period
+            src.in_flight = false;
+            src.next_us = duplicate ? wallClockUs() + std::max<int64_t>(src.period_us / 2, 1000) : 0;
+            if (!duplicate) {
+                sendRequest(src);
+            }
+        }
+        if (!ok) {
+            return;
+        }
+        if (duplicate) {
+            stats_.duplicates[i]++;
+            return;
+        }
+        if (src.queued_any && frame.header.capture_us > src.last_capture_us) {
+            src.period_us = std::min<int64_t>(frame.header.capture_us - src.last_capture_us, 100 * 1000);
+        }
+        src.queued_any = true;
+        src.last_seq = frame.header.seq;
+        src.last_capture_us = frame.header.capture_us;
+        stats_.received[i]++;
+        // message_t buffers do not move with the vector, the part pointers stay valid
+        src.queue.push_back(std::move(frame));
+        if (src.queue.size() > max_queue_) {
+            src.queue.pop_front();
+            stats_.unmatched[i]++;
+        }
+    }
+
+    bool match(FrameBundle &bundle)
+    {
+        while (true) {
+            int64_t newest = INT64_MIN;
+            for (const Source &src : sources_) {
+                if (src.queue.empty()) {
+                    return false;
+                }
+                newest = std::max(newest, src.queue.front().header.capture_us);
+            }
+            // no later frame of the newest head's source can pair with frames too old for it, and of two
+            // candidates the one closer to the newest head wins
+            bool dropped = false;
+            for (size_t i = 0; i < sources_.size(); ++i) {
+                std::deque<FrameMessage> &q = sources_[i].queue;
+                while (!q.empty() && (newest - q.front().header.capture_us > tolerance_us_ ||
+                                      (q.size() > 1 && std::llabs(newest - q[1].header.capture_us) <=
+                                                           std::llabs(newest - q.front().header.capture_us)))) {
+                    q.pop_front();
+                    stats_.unmatched[i]++;
+                    dropped = true;
+                }
+            }
+            if (dropped) {
+                continue;
+            }
+
+            bundle.frames.clear();
+            int64_t oldest = newest;
+            for (Source &src : sources_) {
+                oldest = std::min(oldest, src.queue.front().header.capture_us);
+                bundle.frames.push_back(std::move(src.queue.front()));
+                src.queue.pop_front();
+            }
+            bundle.skew_us = newest - oldest;
+            stats_.bundles++;
+            stats_.skew_sum_us += bundle.skew_us;
+            stats_.skew_max_us = std::max(stats_.skew_max_us, bundle.skew_us);
+            return true;
+        }
+    }
+};
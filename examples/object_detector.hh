@@ -1,7 +1,9 @@
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <opencv2/opencv.hpp>
+#include "letterbox.hh"
 
 extern "C" {
 #include "darknet.h"
@@ -10,119 +12,271 @@ extern "C" {
 #include "option_list.h"
 }
 
+// 一枚分の前処理済みネットワーク入力。前処理を別スレッドで行うときに使う
+struct DetectorInput {
+    LetterboxPreprocessor preprocessor;
+    std::vector<float> tensor;
+    cv::Size size;  // 元画像の大きさ
+};
+
 struct DetectedObject {
-    std::string name;
+    int class_id;
+    const char *name;  // ラベル表の文字列 (検出器が所有)
     float confidence;
     box bbox;
+    int track_id;      // ObjectTracker の追跡 ID (1 から)。追跡していなければ 0
+    int age;           // 検出器が最後にこの物体を出してからのフレーム数 (0 = このフレームで検出)
 };
 
+// darknet の YOLO 検出器。
+// ネットワーク入力と検出結果のバッファは構築時に確保して使い回すので、
+// detect(img, objects) は定常状態でヒープ確保を行わない。
+// (objects の容量は呼び出し側が保持する。最初の数フレームで必要な大きさになる)
 class ObjectDetector {
 public:
-    ObjectDetector(const char *cfgfile, const char *weightfile, const char *datacfg)
+    // max_batch: detect(images, objects) で一度に推論する画像の最大数
+    ObjectDetector(const char *cfgfile, const char *weightfile, const char *datacfg, int max_batch = 1)
+        : max_batch_(std::max(max_batch, 1)), batch_(max_batch_)
     {
-        // Darknetのネットワークを初期化
-        net_ = load_network_custom((char*)cfgfile, (char*)weightfile, 0, 1);
-        set_batch_network(net_, 1);
+        // Darknetのネットワークを初期化 (バッファは max_batch 分確保される)
+        net_ = load_network_custom((char*)cfgfile, (char*)weightfile, 0, max_batch_);
+        set_batch_network(net_, batch_);
 
         // クラス名を読み込み
         list *options = read_data_cfg((char*)datacfg);
         char names[6]="names";
         char *name_list = option_find_str(options, names, 0);
         names_ = get_labels(name_list);
+
+        input_.resize((size_t)net_->w * net_->h * 3 * max_batch_);
+        allocateDetections();
     }
 
-    std::vector<DetectedObject> detect(const cv::Mat &cv_img)
+    ObjectDetector(const ObjectDetector &) = delete;
+    ObjectDetector &operator=(const ObjectDetector &) = delete;
+
+    // objects をクリアして検出結果を入れる。objects の容量はそのまま使う。検出数を返す。
+    size_t detect(const cv::Mat &cv_img, std::vector<DetectedObject> &objects)
     {
-        // OpenCVの画像をdarknetのimageに変換
-#if 1
-        cv::Mat imconv;
-        cv::cvtColor(cv_img, imconv, cv::COLOR_BGR2RGB);
-        image im = mat_to_image(imconv);
-#elif 0
-        image im = mat_to_image2(cv_img);
-#else
-        image im = mat_to_image(cv_img);
-#endif
-        image sized = letterbox_image(im, net_->w, net_->h);
-
-        // 物体検出を行い、結果を取得
-        float *X = sized.data;
-        network_predict_ptr(net_, X);
-        int nboxes = 0;
-        detection *dets = get_network_boxes(net_, im.w, im.h, 0.5, 0.5, 0, 1, &nboxes, 0);
-
-        // 非最大抑制を行い、結果をフィルタリング
-        do_nms_sort(dets, nboxes, net_->layers[net_->n - 1].classes, 0.45);
-
-        // 検出結果を構造体にして返す
-        std::vector<DetectedObject> detected_objects;
-        for (int i = 0; i < nboxes; ++i) {
-            DetectedObject obj;
-            obj.confidence = -1;
-            for (int j = 0; j < net_->layers[net_->n - 1].classes; ++j) {
-                if (dets[i].prob[j] > obj.confidence) {
-                    obj.name = names_[j];
-                    obj.confidence = dets[i].prob[j];
-                    obj.bbox = dets[i].bbox;
-                }
-            }
-            if (obj.confidence > 0.5) {
-                detected_objects.push_back(obj);
-            }
+        // OpenCVの画像をネットワーク入力に変換 (letterbox, RGB, 0..1, CHW を一度に)
+        preprocessor_.run(cv_img, net_->w, net_->h, input_.data());
+
+        // 物体検出を行い、確保済みの検出バッファに結果を書き込む
+        predictBatch(input_.data(), 1);
+        int nboxes = num_detections(net_, kThresh);
+        if (!checkCapacity(nboxes)) {
+            objects.clear();
+            return 0;
         }
+        fill_network_boxes(net_, cv_img.cols, cv_img.rows, kThresh, kHier, 0, 1, dets_.data(), 0);
+        return collect(nboxes, objects);
+    }
+
+    // 複数カメラの画像 (maxBatch() 枚まで) を一つのバッチにして一回の順伝播で検出する。
+    // objects[i] に images[i] の結果が入る。YOLO 層のネットワークのみ。
+    void detect(const std::vector<cv::Mat> &images, std::vector<std::vector<DetectedObject>> &objects)
+    {
+        const int count = (int)images.size();
+        CV_Assert(count > 0 && count <= max_batch_);
 
-        // リソースの解放
-        free_detections(dets, nboxes);
-        free_image(im);
-        free_image(sized);
+        // 各画像をバッチ内の位置に直接書き込む
+        const size_t plane = (size_t)net_->w * net_->h * 3;
+        for (int b = 0; b < count; ++b) {
+            preprocessor_.run(images[b], net_->w, net_->h, input_.data() + b * plane);
+        }
+        predictBatch(input_.data(), count);
+        objects.resize(count);
+        for (int b = 0; b < count; ++b) {
+            boxesBatch(b, images[b].size(), objects[b]);
+        }
+    }
 
-        return detected_objects;
+    // 前処理だけを行う。ネットワークの状態に触れないので、別スレッドから detect() と並行して呼べる。
+    void preprocess(const cv::Mat &cv_img, DetectorInput &input) const
+    {
+        input.tensor.resize((size_t)net_->w * net_->h * 3);
+        input.preprocessor.run(cv_img, net_->w, net_->h, input.tensor.data());
+        input.size = cv_img.size();
     }
 
+    // preprocess() 済みの入力 (maxBatch() 個まで) をまとめて検出する。
+    // 一つだけなら入力をそのままネットワークに渡し、複数ならバッチの入力に並べる。
+    void detect(const std::vector<const DetectorInput *> &inputs, std::vector<std::vector<DetectedObject>> &objects)
+    {
+        const int count = (int)inputs.size();
+        CV_Assert(count > 0 && count <= max_batch_);
+
+        const float *tensor = inputs[0]->tensor.data();
+        if (count > 1) {
+            const size_t plane = (size_t)net_->w * net_->h * 3;
+            for (int b = 0; b < count; ++b) {
+                std::copy(inputs[b]->tensor.begin(), inputs[b]->tensor.end(), input_.begin() + b * plane);
+            }
+            tensor = input_.data();
+        }
+        predictBatch(tensor, count);
+        objects.resize(count);
+        for (int b = 0; b < count; ++b) {
+            boxesBatch(b, inputs[b]->size, objects[b]);
+        }
+    }
+
+    // 毎回新しい vector を返す版 (フレームごとに確保が発生する)
+    std::vector<DetectedObject> detect(const cv::Mat &cv_img)
+    {
+        std::vector<DetectedObject> objects;
+        detect(cv_img, objects);
+        return objects;
+    }
+
+    int maxBatch() const { return max_batch_; }
+    int classes() const { return classes_; }
+    const char *className(int class_id) const { return names_[class_id]; }
+
 private:
+    static constexpr float kThresh = 0.5f;
+    static constexpr float kHier = 0.5f;
+    static constexpr float kNms = 0.45f;
+    static constexpr float kMinConfidence = 0.5f;
+
     network *net_;
     char **names_;
+    int max_batch_;
+    int batch_;                      // 現在ネットワークに設定しているバッチサイズ
+    int classes_ = 0;
+    LetterboxPreprocessor preprocessor_;
+    std::vector<float> input_;       // network input, written in place every frame
+    std::vector<detection> dets_;    // 出力層が出せる最大数の検出
+    std::vector<float> probs_;       // dets_[i].prob の実体 (classes_ 個ずつ)
+    std::vector<float> extras_;      // mask, uc, embeddings の実体
+    std::vector<int> order_;         // NMS の並べ替え用
+
+    // 実際に推論する枚数に合わせる (バッファは max_batch_ 分あるので確保は起きない)
+    void setBatch(int batch)
+    {
+        if (batch != batch_) {
+            set_batch_network(net_, batch);
+            batch_ = batch;
+        }
+    }
 
-    image mat_to_image(const cv::Mat& mat) {
-        int w = mat.cols;
-        int h = mat.rows;
-        int c = mat.channels();
-        image im = make_image(w, h, c);
-        unsigned char *data = (unsigned char *)mat.data;
-        int step = mat.step;
-        for(int y = 0; y < h; ++y) {
-            for(int x = 0; x < w; ++x) {
-                for(int k= 0; k < c; ++k) {
-                    im.data[k*w*h + y*w + x] = data[y*step + x*c + k]/255.0;
+    void predictBatch(const float *tensor, int count)
+    {
+        setBatch(count);
+        network_predict_ptr(net_, const_cast<float *>(tensor));
+    }
+
+    // バッチ内の画像 b の検出を取り出す (検出バッファは画像ごとに使い回す)
+    void boxesBatch(int b, cv::Size size, std::vector<DetectedObject> &objects)
+    {
+        int nboxes = num_detections_batch(net_, kThresh, b);
+        if (!checkCapacity(nboxes)) {
+            objects.clear();
+            return;
+        }
+        fill_network_boxes_batch(net_, size.width, size.height, kThresh, kHier, 0, 1, dets_.data(), 0, b);
+        collect(nboxes, objects);
+    }
+
+    bool checkCapacity(int nboxes) const
+    {
+        if (nboxes > (int)dets_.size()) {  // 構築時に出力層から求めた上限を超えることはない
+            std::cerr << "ObjectDetector: " << nboxes << " boxes exceed capacity " << dets_.size() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // 非最大抑制を行い、信頼度の高いものを objects に入れる
+    size_t collect(int nboxes, std::vector<DetectedObject> &objects)
+    {
+        objects.clear();
+        nmsSort(nboxes);
+        for (int i = 0; i < nboxes; ++i) {
+            const detection &det = dets_[i];
+            int best = 0;
+            for (int j = 1; j < classes_; ++j) {
+                if (det.prob[j] > det.prob[best]) {
+                    best = j;
                 }
             }
+            if (det.prob[best] > kMinConfidence) {
+                objects.push_back({best, names_[best], det.prob[best], det.bbox, 0, 0});
+            }
         }
-        return im;
+        return objects.size();
     }
-    image mat_to_image2(const cv::Mat& mat) {
-        int w = mat.cols;
-        int h = mat.rows;
-        int c = mat.channels();
-        image im = make_image(w, h, c);
-        unsigned char *data = (unsigned char *)mat.data;
-        int step = mat.step;
-        for(int y = 0; y < h; ++y) {
-            for(int x = 0; x < w; ++x) {
-                for(int k = 0; k < c; ++k) {
-                    int src_index = y * step + x * c + k;
-                    int dst_index = k * w * h + y * w + x;
-                    // BGRからRGBに変換
-                    if (c == 3 && k == 0) {
-                        dst_index += 2 * w * h;
-                    } else if (c == 3 && k == 2) {
-                        dst_index -= 2 * w * h;
+
+    // make_network_boxes() と同じ形の検出配列を、全出力層の最大数で一度だけ作る
+    void allocateDetections()
+    {
+        size_t capacity = 0;
+        for (int i = 0; i < net_->n; ++i) {
+            const layer &l = net_->layers[i];
+            if (l.type == YOLO || l.type == GAUSSIAN_YOLO || l.type == REGION) {
+                capacity += (size_t)l.w * l.h * l.n;
+            } else if (l.type == DETECTION) {
+                capacity += (size_t)l.side * l.side * l.n;
+            }
+        }
+        const layer &out = net_->layers[net_->n - 1];
+        classes_ = out.classes;
+        size_t masks = out.coords > 4 ? out.coords - 4 : 0;
+        size_t uc = out.type == GAUSSIAN_YOLO ? 4 : 0;
+        size_t embeddings = out.embedding_output ? out.embedding_size : 0;
+        size_t extra = masks + uc + embeddings;
+
+        dets_.assign(capacity, detection());
+        probs_.assign(capacity * classes_, 0.0f);
+        extras_.assign(capacity * extra, 0.0f);
+        order_.reserve(capacity);
+        for (size_t i = 0; i < capacity; ++i) {
+            detection &det = dets_[i];
+            det.prob = probs_.data() + i * classes_;
+            float *p = extras_.data() + i * extra;
+            det.mask = masks ? p : nullptr;
+            det.uc = uc ? p + masks : nullptr;
+            det.embeddings = embeddings ? p + masks + uc : nullptr;
+            det.embedding_size = out.embedding_size;
+        }
+    }
+
+    static float iou(const box &a, const box &b)
+    {
+        float w = std::min(a.x + a.w / 2, b.x + b.w / 2) - std::max(a.x - a.w / 2, b.x - b.w / 2);
+        float h = std::min(a.y + a.h / 2, b.y + b.h / 2) - std::max(a.y - a.h / 2, b.y - b.h / 2);
+        if (w <= 0 || h <= 0) {
+            return 0;
+        }
+        float inter = w * h;
+        return inter / (a.w * a.h + b.w * b.h - inter);
+    }
+
+    // do_nms_sort() と同じ結果。qsort は作業領域を確保することがあるので、
+    // クラスごとに確率が 0 でない検出だけの添字を std::sort で並べる。
+    void nmsSort(int nboxes)
+    {
+        for (int k = 0; k < classes_; ++k) {
+            order_.clear();
+            for (int i = 0; i < nboxes; ++i) {
+                if (dets_[i].prob[k] > 0) {
+                    order_.push_back(i);
+                }
+            }
+            std::sort(order_.begin(), order_.end(),
+                      [this, k](int a, int b) { return dets_[a].prob[k] > dets_[b].prob[k]; });
+            for (size_t i = 0; i < order_.size(); ++i) {
+                const detection &a = dets_[order_[i]];
+                if (a.prob[k] == 0) {
+                    continue;
+                }
+                for (size_t j = i + 1; j < order_.size(); ++j) {
+                    detection &b = dets_[order_[j]];
+                    if (iou(a.bbox, b.bbox) > kNms) {
+                        b.prob[k] = 0;
                     }
-                    im.data[dst_index] = data[src_index] / 255.0;
                 }
             }
         }
-        return im;
     }
-
 };
-
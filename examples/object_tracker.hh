@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// Detect-every-N tracking: the detector runs on some frames, the tracker
+// carries its boxes over the frames in between.
+//
+// Every object gets a track with a constant velocity Kalman filter on the
+// box centre and size (each coordinate its own position/velocity filter,
+// noise proportional to the box height). On a detected frame update()
+// predicts the tracks, associates them greedily by IoU with the detections
+// of the same class and stamps the detections with their track ids; new
+// objects start new tracks, tracks missed by more than max_missed detections
+// are dropped. On other frames propagate() predicts the tracks and, with
+// use_flow, corrects their centres by the median sparse optical flow of a few
+// points inside each box, then emits them like detections. The confidence of
+// a propagated box decays per frame (twice as fast when the flow was lost);
+// needDetection() asks for the detector every `interval` frames, or earlier
+// when a box decayed below min_confidence.
+//
+// Object is DetectedObject or alike: class_id, confidence, a darknet style
+// relative bbox (centre x, y, w, h), track_id, which is 0 when not tracked,
+// and age, the frames since the box was detected.
+
+struct TrackerOptions {
+    int interval = 3;               // detect every interval frames at the latest
+    float min_confidence = 0.4f;    // detect earlier when a propagated box falls below
+    float decay = 0.9f;             // confidence factor per propagated frame
+    float min_iou = 0.3f;           // association of detections to predicted boxes
+    int max_missed = 1;             // detections a track may miss before it is dropped
+    bool use_flow = false;          // correct propagated boxes by sparse optical flow
+};
+
+struct TrackerStats {
+    uint64_t frames = 0;
+    uint64_t detected = 0;          // frames the detector ran on
+    uint64_t propagated = 0;        // frames served from the tracks
+    uint64_t tracks = 0;            // tracks started
+    uint64_t flow_lost = 0;         // propagated boxes the flow could not follow
+    double detectedRatio() const { return frames ? (double)detected / frames : 0.0; }
+};
+
+template <typename Object>
+class ObjectTracker {
+public:
+    using Box = decltype(Object::bbox);
+
+    explicit ObjectTracker(const TrackerOptions &opt = TrackerOptions()) : opt_(opt) {}
+
+    bool needDetection() const
+    {
+        if (stats_.detected == 0 || since_detection_ + 1 >= std::max(opt_.interval, 1)) {
+            return true;
+        }
+        for (const Track &t : tracks_) {
+            if (t.missed == 0 && t.object.confidence < opt_.min_confidence) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // objects: the detections of image, which get their track ids.
+    void update(const cv::Mat &image, std::vector<Object> &objects)
+    {
+        stats_.frames++;
+        stats_.detected++;
+        since_detection_ = 0;
+        for (Track &t : tracks_) {
+            t.predict();
+        }
+
+        // greedy association, best overlap first
+        pairs_.clear();
+        for (size_t i = 0; i < tracks_.size(); ++i) {
+            for (size_t j = 0; j < objects.size(); ++j) {
+                if (tracks_[i].object.class_id != objects[j].class_id) {
+                    continue;
+                }
+                float overlap = iou(tracks_[i].box(), objects[j].bbox);
+                if (overlap >= opt_.min_iou) {
+                    pairs_.push_back({overlap, (int)i, (int)j});
+                }
+            }
+        }
+        std::sort(pairs_.begin(), pairs_.end(), [](const Pair &a, const Pair &b) { return a.iou > b.iou; });
+        matched_track_.assign(tracks_.size(), false);
+        matched_object_.assign(objects.size(), false);
+        for (const Pair &p : pairs_) {
+            if (matched_track_[p.track] || matched_object_[p.object]) {
+                continue;
+            }
+            matched_track_[p.track] = matched_object_[p.object] = true;
+            Track &t = tracks_[p.track];
+            objects[p.object].age = 0;
+            t.correct(objects[p.object].bbox);
+            t.missed = 0;
+            objects[p.object].track_id = t.object.track_id;
+            t.object = objects[p.object];
+        }
+        for (size_t i = 0; i < tracks_.size(); ++i) {
+            if (!matched_track_[i]) {
+                tracks_[i].missed++;
+            }
+        }
+        tracks_.erase(std::remove_if(tracks_.begin(), tracks_.end(),
+                                     [this](const Track &t) { return t.missed > opt_.max_missed; }),
+                      tracks_.end());
+        for (size_t j = 0; j < objects.size(); ++j) {
+            if (!matched_object_[j]) {
+                objects[j].age = 0;
+                objects[j].track_id = nextId();
+                tracks_.push_back(Track(objects[j]));
+                stats_.tracks++;
+            }
+        }
+        keepFrame(image);
+    }
+
+    // objects: the tracked boxes of image, without running the detector.
+    void propagate(const cv::Mat &image, std::vector<Object> &objects)
+    {
+        stats_.frames++;
+        stats_.propagated++;
+        since_detection_++;
+        bool flow = opt_.use_flow && !prev_gray_.empty() && !tracks_.empty();
+        if (flow) {
+            cv::cvtColor(image, gray_, cv::COLOR_BGR2GRAY);
+            trackPoints();
+        }
+        objects.clear();
+        for (size_t i = 0; i < tracks_.size(); ++i) {
+            Track &t = tracks_[i];
+            t.predict();
+            if (t.missed > 0) {
+                continue;
+            }
+            float decay = opt_.decay;
+            if (flow) {
+                cv::Point2f shift;
+                if (flowShift(i, image.size(), shift)) {
+                    t.correctCentre(t.last.x + shift.x, t.last.y + shift.y);
+                } else {
+                    decay *= opt_.decay;
+                    stats_.flow_lost++;
+                }
+            }
+            t.object.confidence *= decay;
+            t.object.age++;
+            t.object.bbox = t.box();
+            objects.push_back(t.object);
+        }
+        if (flow) {
+            std::swap(prev_gray_, gray_);
+        }
+    }
+
+    TrackerStats stats() const { return stats_; }
+
+    void printStats(const char *name, FILE *fp = stdout) const
+    {
+        fprintf(fp, "tracker %s: %llu frames, %.1f%% detected, %llu tracks, %llu boxes lost by the flow\n", name,
+                (unsigned long long)stats_.frames, stats_.detectedRatio() * 100, (unsigned long long)stats_.tracks,
+                (unsigned long long)stats_.flow_lost);
+    }
+
+private:
+    // position and velocity of one box coordinate, in relative units per frame
+    struct Axis {
+        float p = 0, v = 0;
+        float a = 0, b = 0, d = 0;  // covariance [a b; b d]
+
+        void init(float z, float std_p, float std_v)
+        {
+            p = z;
+            v = 0;
+            a = 4 * std_p * std_p;
+            b = 0;
+            d = 100 * std_v * std_v;
+        }
+
+        void predict(float std_p, float std_v)
+        {
+            p += v;
+            a += 2 * b + d + std_p * std_p;
+            b += d;
+            d += std_v * std_v;
+        }
+
+        void correct(float z, float std_z)
+        {
+            float s = a + std_z * std_z;
+            float k0 = a / s, k1 = b / s;
+            float y = z - p;
+            p += k0 * y;
+            v += k1 * y;
+            d -= k1 * b;
+            a *= 1 - k0;
+            b *= 1 - k0;
+        }
+    };
+
+    struct Track {
+        Object object;
+        Axis x, y, w, h;
+        int missed = 0;
+        Box last;                  // box before the last prediction, where the flow starts
+
+        explicit Track(const Object &obj) : object(obj), last(obj.bbox)
+        {
+            float sp = kStdPosition * obj.bbox.h, sv = kStdVelocity * obj.bbox.h;
+            x.init(obj.bbox.x, sp, sv);
+            y.init(obj.bbox.y, sp, sv);
+            w.init(obj.bbox.w, sp, sv);
+            h.init(obj.bbox.h, sp, sv);
+        }
+
+        void predict()
+        {
+            last = box();
+            float sp = kStdPosition * h.p, sv = kStdVelocity * h.p;
+            x.predict(sp, sv);
+            y.predict(sp, sv);
+            w.predict(sp, sv);
+            h.predict(sp, sv);
+        }
+
+        void correct(const Box &z)
+        {
+            float sz = kStdPosition * h.p;
+            x.correct(z.x, sz);
+            y.correct(z.y, sz);
+            w.correct(z.w, sz);
+            h.correct(z.h, sz);
+        }
+
+        void correctCentre(float cx, float cy)
+        {
+            float sz = 2 * kStdPosition * h.p;  // flow is less certain than a detection
+            x.correct(cx, sz);
+            y.correct(cy, sz);
+        }
+
+        Box box() const
+        {
+            Box b = object.bbox;
+            b.x = x.p;
+            b.y = y.p;
+            b.w = std::max(w.p, 0.0f);
+            b.h = std::max(h.p, 0.0f);
+            return b;
+        }
+    };
+
+    struct Pair {
+        float iou;
+        int track, object;
+    };
+
+    static constexpr float kStdPosition = 1.0f / 20;   // of the box height
+    static constexpr float kStdVelocity = 1.0f / 160;
+    static constexpr int kGrid = 3;                    // flow points per box: kGrid x kGrid
+    static constexpr int kMinFlowPoints = 3;
+
+    TrackerOptions opt_;
+    TrackerStats stats_;
+    std::vector<Track> tracks_;
+    int since_detection_ = 0;
+    int next_id_ = 0;
+    std::vector<Pair> pairs_;
+    std::vector<bool> matched_track_, matched_object_;
+    cv::Mat gray_, prev_gray_;
+    std::vector<cv::Point2f> points_, moved_;
+    std::vector<uint8_t> status_;
+    std::vector<float> error_, dx_, dy_;
+
+    int nextId()
+    {
+        next_id_ = next_id_ % 65535 + 1;  // 1..65535, fits the datagram's track_id
+        return next_id_;
+    }
+
+    void keepFrame(const cv::Mat &image)
+    {
+        if (opt_.use_flow) {
+            cv::cvtColor(image, prev_gray_, cv::COLOR_BGR2GRAY);
+        }
+    }
+
+    // Flows a grid of points in the central half of every track's box from prev_gray_ to gray_.
+    void trackPoints()
+    {
+        points_.clear();
+        for (const Track &t : tracks_) {
+            Box b = t.box();
+            for (int i = 0; i < kGrid; ++i) {
+                for (int j = 0; j < kGrid; ++j) {
+                    float u = b.x + b.w * ((j + 0.5f) / kGrid - 0.5f) / 2;
+                    float v = b.y + b.h * ((i + 0.5f) / kGrid - 0.5f) / 2;
+                    points_.push_back(cv::Point2f(u * prev_gray_.cols, v * prev_gray_.rows));
+                }
+            }
+        }
+        cv::calcOpticalFlowPyrLK(prev_gray_, gray_, points_, moved_, status_, error_, cv::Size(15, 15), 2);
+    }
+
+    // Median shift of track i's points, relative to the image size.
+    bool flowShift(size_t i, cv::Size size, cv::Point2f &shift)
+    {
+        dx_.clear();
+        dy_.clear();
+        for (size_t k = i * kGrid * kGrid; k < (i + 1) * kGrid * kGrid; ++k) {
+            if (status_[k]) {
+                dx_.push_back(moved_[k].x - points_[k].x);
+                dy_.push_back(moved_[k].y - points_[k].y);
+            }
+        }
+        if ((int)dx_.size() < kMinFlowPoints) {
+            return false;
+        }
+        std::nth_element(dx_.begin(), dx_.begin() + dx_.size() / 2, dx_.end());
+        std::nth_element(dy_.begin(), dy_.begin() + dy_.size() / 2, dy_.end());
+        shift = cv::Point2f(dx_[dx_.size() / 2] / size.width, dy_[dy_.size() / 2] / size.height);
+        return true;
+    }
+
+    template <typename Box>
+    static float iou(const Box &a, const Box &b)
+    {
+        float w = std::min(a.x + a.w / 2, b.x + b.w / 2) - std::max(a.x - a.w / 2, b.x - b.w / 2);
+        float h = std::min(a.y + a.h / 2, b.y + b.h / 2) - std::max(a.y - a.h / 2, b.y - b.h / 2);
+        if (w <= 0 || h <= 0) {
+            return 0;
+        }
+        float inter = w * h;
+        return inter / (a.w * a.h + b.w * b.h - inter);
+    }
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Building blocks of staged receivers: bounded queues between the stage
+// threads and per stage timing.
+
+// Fixed capacity FIFO. push() waits for room, so a slow stage holds back
+// the one in front of it instead of letting frames pile up. The ring is
+// allocated once; items are moved in and out of its slots.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : ring_(std::max<size_t>(capacity, 1)) {}
+
+    // Returns false if the queue was closed, item is left as it was.
+    bool push(T &&item)
+    {
+        {
+            std::unique_lock<std::mutex> lock(lock_);
+            not_full_.wait(lock, [this] { return closed_ || count_ < ring_.size(); });
+            if (closed_) {
+                return false;
+            }
+            ring_[(head_ + count_) % ring_.size()] = std::move(item);
+            count_++;
+        }
+        not_empty_.notify_one();
+        return true;
+    }
+
+    // Returns false if nothing arrived within timeout, or the queue is closed and empty.
+    bool pop(T &item, std::chrono::milliseconds timeout)
+    {
+        {
+            std::unique_lock<std::mutex> lock(lock_);
+            if (!not_empty_.wait_for(lock, timeout, [this] { return closed_ || count_ > 0; }) || count_ == 0) {
+                return false;
+            }
+            item = std::move(ring_[head_]);
+            head_ = (head_ + 1) % ring_.size();
+            count_--;
+        }
+        not_full_.notify_one();
+        return true;
+    }
+
+    // Fails further pushes and wakes everybody up; what is queued can still be popped.
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            closed_ = true;
+        }
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        return count_;
+    }
+
+private:
+    std::vector<T> ring_;
+    size_t head_ = 0;
+    size_t count_ = 0;
+    bool closed_ = false;
+    mutable std::mutex lock_;
+    std::condition_variable not_full_, not_empty_;
+};
+
+// Busy time of each pipeline stage. print() shows, per stage, the mean and
+// maximum time per item and how busy the stage's threads were since the
+// previous print(); the computing stage with the highest load is the
+// bottleneck and is marked. Stages which mostly wait (a REQ round trip) are
+// listed but not marked, they are busy whenever the rest keeps up.
+class StageTimes {
+public:
+    // threads: how many threads run the stage, its load is averaged over them
+    int addStage(const std::string &name, int threads = 1, bool waits = false)
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        stages_.push_back({name, std::max(threads, 1), waits});
+        return (int)stages_.size() - 1;
+    }
+
+    void add(int stage, double us)
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        Stage &s = stages_[stage];
+        s.count++;
+        s.sum_us += us;
+        s.max_us = std::max(s.max_us, us);
+    }
+
+    void print(FILE *fp = stdout)
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        auto now = std::chrono::steady_clock::now();
+        double period_us = std::chrono::duration<double, std::micro>(now - since_).count();
+        since_ = now;
+        size_t slowest = stages_.size();
+        for (size_t i = 0; i < stages_.size(); ++i) {
+            if (!stages_[i].waits && stages_[i].count > 0 &&
+                (slowest == stages_.size() || load(stages_[i], period_us) > load(stages_[slowest], period_us))) {
+                slowest = i;
+            }
+        }
+        fprintf(fp, "stages over %.1f s (ms per item mean/max, load):\n", period_us / 1e6);
+        for (size_t i = 0; i < stages_.size(); ++i) {
+            Stage &s = stages_[i];
+            fprintf(fp, "  %-12s %8.2f /%8.2f  %5.1f%%  %6llu items%s\n", s.name.c_str(),
+                    s.count ? s.sum_us / s.count / 1000.0 : 0.0, s.max_us / 1000.0, load(s, period_us) * 100,
+                    (unsigned long long)s.count, i == slowest ? "  <- slowest" : "");
+            s.count = 0;
+            s.sum_us = 0;
+            s.max_us = 0;
+        }
+    }
+
+private:
+    struct Stage {
+        std::string name;
+        int threads;
+        bool waits;
+        uint64_t count = 0;
+        double sum_us = 0;
+        double max_us = 0;
+    };
+
+    std::vector<Stage> stages_;
+    std::chrono::steady_clock::time_point since_ = std::chrono::steady_clock::now();
+    std::mutex lock_;
+
+    static double load(const Stage &s, double period_us)
+    {
+        return period_us > 0 ? s.sum_us / (period_us * s.threads) : 0.0;
+    }
+};
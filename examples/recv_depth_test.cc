@@ -0,0 +1,74 @@
+#include <zmq.hpp>
+#include <string>
+#include <iostream>
+#include <opencv2/opencv.hpp>
+#include <PointCloudCodec.hpp>
+#include "depth_codec.hh"
+#include "frame_protocol.hh"
+
+// usage: recv_depth_test [server_ip] [--cloud]
+// Subscribes to the depth stream of image_server --depth (latest frame only)
+// and shows it, or with --cloud to the point cloud stream of image_server --cloud.
+int main(int argc, char *argv[]) {
+    std::string server = "192.168.123.13";
+    bool cloud = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--cloud") {
+            cloud = true;
+        } else {
+            server = arg;
+        }
+    }
+
+    zmq::context_t context(1);
+    zmq::socket_t socket(context, ZMQ_SUB);
+    socket.set(zmq::sockopt::conflate, 1);  // keep only the newest frame
+    socket.set(zmq::sockopt::subscribe, "");
+    socket.connect("tcp://" + server + (cloud ? ":25664" : ":25663"));
+    std::cout << "Connecting to server…" << std::endl;
+
+    FrameMessage frame;
+    cv::Mat mm, view;
+    std::vector<cv::Vec3f> pcl;
+    PointCloudCodec codec;
+    while (true) {
+        if (!recvFrameMessage(socket, frame) || frame.left == nullptr) {
+            std::cerr << "Unknown stream message." << std::endl;
+            continue;
+        }
+        const FrameHeader &hdr = frame.header;
+        double latency = (wallClockUs() - hdr.capture_us) / 1000.0;
+
+        if (hdr.encoding == FRAME_ENCODING_POINT_CLOUD) {
+            int64_t start_us = wallClockUs();
+            if (!codec.decode(frame.left, hdr.left_bytes, pcl)) {
+                std::cerr << "Point cloud is corrupted." << std::endl;
+                continue;
+            }
+            std::cout << "Cloud " << hdr.seq << ": " << pcl.size() << " points, " << hdr.left_bytes << " bytes"
+                      << " (" << pcl.size() * sizeof(cv::Vec3f) / (double)hdr.left_bytes << "x), decode "
+                      << (wallClockUs() - start_us) / 1000.0 << " ms, latency "
+                      << latency << " ms" << std::endl;
+            continue;
+        }
+
+        if (hdr.encoding != FRAME_ENCODING_PNG16_DEPTH || !decodeDepth(frame.left, hdr.left_bytes, mm)) {
+            std::cerr << "Depth frame is corrupted." << std::endl;
+            continue;
+        }
+        const char *source = !(hdr.flags & FRAME_DEPTH_8BIT)     ? ""
+                             : (hdr.flags & FRAME_DEPTH_RANGE_SET) ? " (8 bit, configured range)"
+                                                                   : " (8 bit, assumed range)";
+        std::cout << "Depth " << hdr.seq << ": center " << mm.at<uint16_t>(mm.rows / 2, mm.cols / 2) << " mm" << source
+                  << ", latency " << latency << " ms" << std::endl;
+
+        // show 0..4 m
+        mm.convertTo(view, CV_8U, 255.0 / 4000.0);
+        cv::applyColorMap(view, view, cv::COLORMAP_JET);
+        cv::imshow("Received Depth", view);
+        if (cv::waitKey(1) >= 0) break;
+    }
+
+    return 0;
+}
@@ -8,11 +8,22 @@
 #include <filesystem>
 #include <thread>
 #include <chrono>
+#include <atomic>
+#include <vector>
+#include <mutex>
 #include "object_detector.hh"
+#include "frame_protocol.hh"
+#include "frame_recorder.hh"
+#include "jpeg_decoder.hh"
+#include "frame_batcher.hh"
+#include "pipeline.hh"
+#include "detection_protocol.hh"
+#include "depth_codec.hh"
+#include "box_depth.hh"
+#include "object_tracker.hh"
+#include "motion_gate.hh"
 #include <boost/asio.hpp>
 
-#define USE_LEFT_CAMERA 0
-
 std::string getTimeStampedFolderName() {
     // Get current time
     std::time_t t = std::time(0);
@@ -30,42 +41,399 @@ std::string getTimeStampedFolderName() {
     return ss.str();
 }
 
-cv::Mat receiveImage(zmq::socket_t& socket, const std::string& serverName) {
-    while (true) {
-        // Send request
-        zmq::message_t request(6);
-        memcpy(request.data(), "Hello", 6);
-        std::cout << "Sending request to " << serverName << "…" << std::endl;
-        socket.send(request, zmq::send_flags::none);
-
-        // Set the receive timeout
-        int timeout = 1000; // 1 second
-        socket.set(zmq::sockopt::rcvtimeo, timeout);
-
-        // Get the reply
-        zmq::message_t reply;
-        if (!socket.recv(reply, zmq::recv_flags::none)) {
+// Waits for the reply to req. Returns false when running was cleared.
+bool receiveFrame(zmq::socket_t& socket, const std::string& serverName, const FrameRequest& req, FrameMessage& frame,
+                  const std::atomic<bool>& running) {
+    while (running) {
+        socket.send(zmq::buffer(&req, sizeof(req)), zmq::send_flags::none);
+
+        // Get the reply (the socket has a 1 second receive timeout)
+        if (!recvFrameMessage(socket, frame) || frame.left == nullptr) {
             std::cerr << "Failed to receive data from " << serverName << " within the timeout period. Retrying..." << std::endl;
             continue;
         }
+        return true;
+    }
+    return false;
+}
 
-        // Decode the image
-        std::vector<char> data(static_cast<char*>(reply.data()), static_cast<char*>(reply.data()) + reply.size());
-        cv::Mat img = cv::imdecode(cv::Mat(data), cv::IMREAD_COLOR);
+struct Camera {
+    std::string name;
+    std::string endpoint;
+    std::string depthEndpoint;  // image_server --depth stream, empty without --depth
+    FrameRequest req;
+    std::string folder;
+};
 
-        if (img.empty()) {
-            std::cerr << "Received empty or corrupted image from " << serverName << ". Retrying..." << std::endl;
-            continue;
+// A received depth frame with the intrinsics the server sent along, if any.
+struct DepthFrame {
+    int64_t capture_us = 0;
+    cv::Mat mm;
+    bool calibrated = false;  // intrinsics are the camera's calibration
+    PinholeIntrinsics intrinsics;
+};
+
+// The last few depth frames of a camera, looked up by capture time stamp.
+class DepthCache {
+public:
+    void put(const DepthFrame& frame) {
+        std::lock_guard<std::mutex> lock(lock_);
+        slots_[next_++ % kSlots] = frame;  // decodeDepth() makes a new buffer per frame, readers keep theirs
+    }
+
+    // The frame closest to capture_us, if one is within tolerance_us.
+    bool find(int64_t capture_us, int64_t tolerance_us, DepthFrame& frame) const {
+        std::lock_guard<std::mutex> lock(lock_);
+        const DepthFrame* best = nullptr;
+        for (const DepthFrame& slot : slots_) {
+            if (!slot.mm.empty() && std::llabs(slot.capture_us - capture_us) <= tolerance_us &&
+                (best == nullptr || std::llabs(slot.capture_us - capture_us) < std::llabs(best->capture_us - capture_us))) {
+                best = &slot;
+            }
+        }
+        if (best == nullptr) {
+            return false;
+        }
+        frame = *best;
+        return true;
+    }
+
+private:
+    static constexpr size_t kSlots = 4;
+    DepthFrame slots_[kSlots];
+    size_t next_ = 0;
+    mutable std::mutex lock_;
+};
+
+// receiver -> decoder
+struct Received {
+    int camera = 0;
+    int64_t receive_us = 0;
+    FrameMessage frame;
+};
+
+// decoder -> inference, latest only per camera
+struct Prepared {
+    uint64_t seq = 0;
+    int64_t capture_us = 0;
+    int64_t receive_us = 0;
+    cv::Rect roi;  // region of the left part the image shows
+    cv::Mat image;
+    DetectorInput input;
+};
+
+// inference -> output, recycled through a free list
+struct Result {
+    int camera = 0;
+    uint64_t seq = 0;
+    int64_t capture_us = 0;
+    int64_t receive_us = 0;
+    int age = 0;  // frames since the detector last ran on the camera
+    cv::Rect roi;
+    cv::Mat image;
+    std::vector<DetectedObject> objects;
+    std::vector<BoxDepth> depths;  // per object with --depth, otherwise empty
+};
+
+// Stage threads and the queues between them:
+//
+//   receiver (one per camera)  REQ round trip
+//   depth (one per camera)     --depth: SUB to the depth stream, into depthCaches
+//     -> decodeQueue (bounded)
+//   decoder                    JPEG decode, recording, letterbox preprocessing
+//     -> batcher (latest only per camera, batched within the deadline)
+//   inference                  --motion-gate: unchanged images keep their previous detections,
+//                              one forward pass per batch over the cameras due for detection,
+//                              tracking (examples/object_tracker.hh) for the others
+//     -> outputQueue (bounded), results come back through freeResults
+//   output (main thread)       depth of the boxes, UDP send, drawing, imshow
+struct Pipeline {
+    Pipeline(const std::vector<Camera>& cameras, ObjectDetector& detector, std::chrono::microseconds deadline,
+             const TrackerOptions& tracking, bool useGate)
+        : cameras(cameras), detector(detector), trackers(cameras.size(), ObjectTracker<DetectedObject>(tracking)),
+          useGate(useGate), gates(cameras.size()),
+          decodeQueue(2 * cameras.size()),
+          batcher((int)cameras.size(), deadline), outputQueue(2 * cameras.size()),
+          freeResults(2 * cameras.size()), depthCaches(cameras.size())
+    {
+        for (size_t i = 0; i < 2 * cameras.size(); i++) {
+            freeResults.push(Result());
+        }
+        receiveStage = times.addStage("receive", (int)cameras.size(), true);
+        decodeStage = times.addStage("decode");
+        preprocessStage = times.addStage("preprocess");
+        inferStage = times.addStage("infer");
+        trackStage = times.addStage("track");
+        outputStage = times.addStage("output");
+    }
+
+    const std::vector<Camera>& cameras;
+    ObjectDetector& detector;
+    std::vector<ObjectTracker<DetectedObject>> trackers;  // per camera, used by the inference thread only
+    bool useGate;
+    std::vector<MotionGate> gates;                        // likewise
+    FrameRecorder recorder;  // saves the received JPEGs as they are
+    BoundedQueue<Received> decodeQueue;
+    FrameBatcher<Prepared> batcher;
+    BoundedQueue<Result> outputQueue;
+    BoundedQueue<Result> freeResults;
+    std::vector<DepthCache> depthCaches;
+    StageTimes times;
+    int receiveStage, decodeStage, preprocessStage, inferStage, trackStage, outputStage;
+    std::atomic<bool> running{true};
+
+    void receive(zmq::context_t& context, int index) {
+        const Camera& camera = cameras[index];
+        zmq::socket_t socket(context, ZMQ_REQ);
+        socket.set(zmq::sockopt::rcvtimeo, 1000);
+        socket.set(zmq::sockopt::linger, 0);
+        socket.set(zmq::sockopt::req_relaxed, 1);  // a request may be sent again after a timeout
+        socket.set(zmq::sockopt::req_correlate, 1);
+        socket.connect(camera.endpoint);
+
+        Received item;
+        item.camera = index;
+        while (true) {
+            double t0 = wallClockUs();
+            if (!receiveFrame(socket, camera.name, camera.req, item.frame, running)) {
+                break;
+            }
+            item.receive_us = wallClockUs();
+            times.add(receiveStage, item.receive_us - t0);
+            if (!decodeQueue.push(std::move(item))) {
+                break;
+            }
+            item.frame = FrameMessage();
+        }
+    }
+
+    void receiveDepth(zmq::context_t& context, int index) {
+        const Camera& camera = cameras[index];
+        zmq::socket_t socket(context, ZMQ_SUB);
+        socket.set(zmq::sockopt::rcvtimeo, 1000);
+        socket.set(zmq::sockopt::linger, 0);
+        socket.set(zmq::sockopt::subscribe, "");
+        socket.connect(camera.depthEndpoint);
+
+        FrameMessage frame;
+        DepthFrame depth;
+        bool warnedRange = false, warnedCalib = false;
+        while (running) {
+            if (!recvFrameMessage(socket, frame) || frame.left == nullptr) {
+                continue;
+            }
+            const FrameHeader& hdr = frame.header;
+            // 8 bit display depth over the server's default guess of the range gives no usable distances
+            if ((hdr.flags & FRAME_DEPTH_8BIT) && !(hdr.flags & FRAME_DEPTH_RANGE_SET)) {
+                if (!warnedRange) {
+                    warnedRange = true;
+                    std::cerr << "Depth of " << camera.name << " is 8 bit over an assumed range, no distances are"
+                              << " reported; start image_server with --depth-range min,max." << std::endl;
+                }
+                continue;
+            }
+            if (hdr.encoding != FRAME_ENCODING_PNG16_DEPTH || !decodeDepth(frame.left, hdr.left_bytes, depth.mm)) {
+                std::cerr << "Depth frame from " << camera.name << " is corrupted." << std::endl;
+                continue;
+            }
+            depth.capture_us = hdr.capture_us;
+            depth.calibrated = frame.right != nullptr && hdr.right_bytes == sizeof(DepthIntrinsics);
+            if (depth.calibrated) {
+                DepthIntrinsics k;
+                memcpy(&k, frame.right, sizeof(k));
+                depth.intrinsics.fx = k.fx;
+                depth.intrinsics.fy = k.fy;
+                depth.intrinsics.cx = k.cx;
+                depth.intrinsics.cy = k.cy;
+            } else if (!warnedCalib) {
+                warnedCalib = true;
+                std::cerr << "Depth of " << camera.name << " comes without calibration, assuming a 90 degree"
+                          << " field of view (or pass --intrinsics)." << std::endl;
+            }
+            depthCaches[index].put(depth);
         }
+    }
 
-        return img;
+    void decode() {
+        JpegDecoder decoder;
+        std::vector<Prepared> staging(cameras.size());  // swapped with consumed ones by the batcher
+        std::vector<int> counters(cameras.size(), 0);
+        Received item;
+        while (running) {
+            if (!decodeQueue.pop(item, std::chrono::milliseconds(100))) {
+                continue;
+            }
+            Prepared& prepared = staging[item.camera];
+            double t0 = wallClockUs();
+            if (!decoder.decode(item.frame, FRAME_PART_LEFT, prepared.image)) {
+                std::cerr << "Received empty or corrupted image from " << cameras[item.camera].name << std::endl;
+                continue;
+            }
+            double t1 = wallClockUs();
+            prepared.seq = item.frame.header.seq;
+            prepared.capture_us = item.frame.header.capture_us;
+            const FrameHeader& hdr = item.frame.header;
+            prepared.roi = hdr.roi_width > 0 ? cv::Rect(hdr.roi_x, hdr.roi_y, hdr.roi_width, hdr.roi_height)
+                                             : cv::Rect(0, 0, prepared.image.cols, prepared.image.rows);
+            std::stringstream ss;
+            ss << cameras[item.camera].folder << "/image_" << std::setfill('0') << std::setw(5) << counters[item.camera]++;
+            recordFrame(recorder, std::move(item.frame), ss.str());
+            detector.preprocess(prepared.image, prepared.input);
+            times.add(decodeStage, t1 - t0);
+            times.add(preprocessStage, wallClockUs() - t1);
+            prepared.receive_us = item.receive_us;
+            batcher.put(item.camera, prepared);
+        }
+    }
+
+    void infer() {
+        std::vector<Prepared> items;
+        std::vector<int> ready;
+        std::vector<const DetectorInput*> inputs;
+        const int tracked = -1, unchanged = -2;
+        std::vector<int> batchIndex;  // per ready camera: its place in the batch, or tracked / unchanged
+        std::vector<std::vector<DetectedObject>> objects;
+        std::vector<std::vector<DetectedObject>> previous(cameras.size());  // last objects sent per camera
+        std::vector<int> ages(cameras.size(), 0);
+        while (running) {
+            if (!batcher.collect(items, ready, std::chrono::milliseconds(100))) {
+                continue;
+            }
+            inputs.clear();
+            batchIndex.assign(ready.size(), tracked);
+            for (size_t i = 0; i < ready.size(); i++) {
+                if (useGate && !gates[ready[i]].changed(items[ready[i]].image)) {
+                    batchIndex[i] = unchanged;
+                } else if (trackers[ready[i]].needDetection()) {
+                    batchIndex[i] = (int)inputs.size();
+                    inputs.push_back(&items[ready[i]].input);
+                }
+            }
+            if (!inputs.empty()) {
+                double t0 = wallClockUs();
+                detector.detect(inputs, objects);
+                double us = wallClockUs() - t0;
+                times.add(inferStage, us);
+                for (size_t i = 0; i < ready.size(); i++) {
+                    if (useGate && batchIndex[i] >= 0) {
+                        gates[ready[i]].accept();
+                        gates[ready[i]].addInference(us / inputs.size());
+                    }
+                }
+            }
+
+            for (size_t i = 0; i < ready.size(); i++) {
+                Result result;
+                while (!freeResults.pop(result, std::chrono::milliseconds(100))) {
+                    if (!running) {
+                        return;
+                    }
+                }
+                Prepared& prepared = items[ready[i]];
+                int camera = ready[i];
+                double t0 = wallClockUs();
+                if (batchIndex[i] == unchanged) {
+                    for (DetectedObject& obj : previous[camera]) {
+                        obj.age++;
+                    }
+                    result.objects = previous[camera];
+                    ages[camera]++;
+                } else if (batchIndex[i] >= 0) {
+                    result.objects = objects[batchIndex[i]];
+                    trackers[camera].update(prepared.image, result.objects);
+                    ages[camera] = 0;
+                } else {
+                    trackers[camera].propagate(prepared.image, result.objects);
+                    ages[camera]++;
+                }
+                times.add(trackStage, wallClockUs() - t0);
+                if (batchIndex[i] != unchanged) {
+                    previous[camera] = result.objects;
+                }
+                result.camera = camera;
+                result.age = ages[camera];
+                result.seq = prepared.seq;
+                result.capture_us = prepared.capture_us;
+                result.receive_us = prepared.receive_us;
+                result.roi = prepared.roi;
+                std::swap(result.image, prepared.image);  // the decoder gets the result's old image back
+                if (!outputQueue.push(std::move(result))) {
+                    return;
+                }
+            }
+        }
+    }
+
+    void stop() {
+        running = false;
+        decodeQueue.close();
+        batcher.stop();
+        outputQueue.close();
+        freeResults.close();
+    }
+};
+
+// Depth of each detected box (--depth). The detector sees the region
+// result.roi of the left part, which is mapped into the depth frame by the
+// ratio of the depth frame to the left part (partSize). Without --intrinsics
+// the depth frame's calibration is used.
+void estimateDepths(BoxDepthEstimator &estimator, bool defaultIntrinsics, const DepthFrame &depth, cv::Size partSize,
+                    Result &result)
+{
+    const cv::Mat &mm = depth.mm;
+    if (defaultIntrinsics) {
+        estimator.setIntrinsics(depth.calibrated ? depth.intrinsics : PinholeIntrinsics::fromHfov(mm.size()));
+    }
+    float sx = (float)mm.cols / partSize.width, sy = (float)mm.rows / partSize.height;
+    cv::Rect2f region(result.roi.x * sx, result.roi.y * sy, result.roi.width * sx, result.roi.height * sy);
+    result.depths.resize(result.objects.size());
+    for (size_t i = 0; i < result.objects.size(); i++) {
+        estimator.estimate(mm, BoxDepthEstimator::boxInDepth(result.objects[i].bbox, region), result.depths[i]);
     }
 }
 
-std::vector<DetectedObject> detect_and_send(ObjectDetector &detector, boost::asio::ip::udp::socket &socket, cv::Mat &image, const std::string &camera_name)
+// One binary datagram per frame, see examples/detection_protocol.hh.
+void sendDetections(boost::asio::ip::udp::socket &socket, const boost::asio::ip::udp::endpoint &endpoint,
+                    DetectionDatagram &datagram, const Result &result, bool bodyFrame)
+{
+    DetectionHeader hdr;
+    hdr.camera = (uint8_t)result.camera;
+    hdr.seq = result.seq;
+    hdr.capture_us = result.capture_us;
+    hdr.age = (uint16_t)std::min(result.age, 65535);
+    if (result.depths.empty()) {
+        datagram.build(hdr, result.objects);
+    } else {
+        hdr.flags = bodyFrame ? DETECTION_BODY_FRAME : 0;
+        datagram.begin(hdr);
+        for (size_t i = 0; i < result.objects.size(); i++) {
+            const DetectedObject& obj = result.objects[i];
+            const BoxDepth& depth = result.depths[i];
+            const cv::Point3f& p = bodyFrame ? depth.body : depth.camera;
+            DetectionRecord rec;
+            rec.class_id = (uint16_t)obj.class_id;
+            rec.track_id = (uint16_t)obj.track_id;
+            rec.confidence = obj.confidence;
+            rec.x = obj.bbox.x;
+            rec.y = obj.bbox.y;
+            rec.w = obj.bbox.w;
+            rec.h = obj.bbox.h;
+            rec.distance = depth.median_m;
+            rec.px = p.x;
+            rec.py = p.y;
+            rec.pz = p.z;
+            if (!datagram.add(rec)) {
+                break;
+            }
+        }
+    }
+    socket.send_to(boost::asio::buffer(datagram.data(), datagram.size()), endpoint);
+}
+
+// Former text format (--csv): one "camera,name,confidence,x,y,w,h" datagram per object, "camera,none,0,0,0,0,0" if there are none.
+void send_detections_csv(boost::asio::ip::udp::socket &socket, const boost::asio::ip::udp::endpoint &endpoint,
+                         const std::vector<DetectedObject> &objects, const std::string &camera_name)
 {
-    boost::asio::ip::udp::endpoint endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 12346);
-    std::vector<DetectedObject> objects = detector.detect(image);
     for (const DetectedObject& obj : objects) {
         std::cout << "  Name: " << obj.name
                   << ", Confidence: " << obj.confidence
@@ -81,92 +449,224 @@ std::vector<DetectedObject> detect_and_send(ObjectDetector &detector, boost::asi
         std::string message = camera_name + ",none,0,0,0,0,0";
         socket.send_to(boost::asio::buffer(message), endpoint);
     }
-    return objects;
 }
 
+void drawDetections(cv::Mat &img, const std::vector<DetectedObject> &objects, const std::vector<BoxDepth> &depths)
+{
+    for (size_t i = 0; i < objects.size(); i++) {
+        const DetectedObject &det = objects[i];
+        int left  = (det.bbox.x - det.bbox.w / 2) * img.cols;
+        int right = (det.bbox.x + det.bbox.w / 2) * img.cols;
+        int top   = (det.bbox.y - det.bbox.h / 2) * img.rows;
+        int bot   = (det.bbox.y + det.bbox.h / 2) * img.rows;
+
+        cv::rectangle(img, cv::Point(left, top), cv::Point(right, bot), cv::Scalar(0, 255, 0), 3);
+        std::string label = "#" + std::to_string(det.track_id) + " " + det.name + " " +
+                            std::to_string((int)(det.confidence * 100)) + "%";
+        if (i < depths.size() && depths[i].ok()) {
+            char distance[16];
+            snprintf(distance, sizeof(distance), " %.2fm", depths[i].median_m);
+            label += distance;
+        }
+        cv::putText(img, label, cv::Point(left, top - 5), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 0), 2);
+    }
+}
+
+// usage: recv_image_detect cfg weights data [--left] [--deadline ms] [--no-show] [--csv]
+//                          [--depth] [--part-size wxh] [--intrinsics fx,fy,cx,cy] [--body x,y,z,pitch]
+//                          [--detect-every n] [--flow] [--motion-gate]
+//
+// Runs as a staged pipeline (see Pipeline) so receiving, decoding,
+// inference and output overlap. Only the newest image of each camera is
+// detected; images of several cameras are batched into one forward pass,
+// waiting at most --deadline after the first one (examples/frame_batcher.hh).
+// Stage timings are printed every 5 seconds. Detections go to UDP port 12346
+// on localhost, one binary datagram per frame (examples/detection_protocol.hh,
+// the camera id is the index: 0 front, 1 left), or with --csv in the former
+// text format.
+//
+// With --depth the receiver also subscribes to the depth stream of each
+// camera (image_server --depth) and adds the distance and 3D position of
+// every box to its record (examples/box_depth.hh): the depth frame closest in
+// capture time is sampled inside the box only. The box is mapped from the
+// image region the server sent into the depth frame by --part-size, the size
+// of the left image the region is cut from. --intrinsics override the depth
+// frame's pinhole parameters, which by default are the rectified intrinsics
+// of the camera's calibration sent with every depth frame (a centred 90
+// degree field of view if the server sends none). The server's depth is
+// metric; only its fallback for uncalibrated cameras, 8 bit display depth,
+// is not used without an explicit --depth-range: boxes then get no distance
+// or position. Positions are in the camera frame, or with --body x,y,z,pitch
+// (camera position in metres, pitch down in degrees) in a body frame with x
+// forward, y left, z up.
+//
+// Every box carries a track id (examples/object_tracker.hh). With
+// --detect-every n the network runs on every n-th frame of a camera (earlier
+// when a tracked box loses confidence) and the boxes are propagated by the
+// tracker in between, with --flow corrected by sparse optical flow.
+//
+// --motion-gate skips inference (and tracking) on images which did not
+// change since the camera's last inference (examples/motion_gate.hh) and
+// sends the previous detections again, with their age; skip rates and the
+// inference time saved are printed at exit.
 int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        std::cerr << "usage: " << argv[0] << " cfg weights data [--left] [--deadline ms] [--no-show] [--csv]"
+                  << " [--depth] [--part-size wxh] [--intrinsics fx,fy,cx,cy] [--body x,y,z,pitch]"
+                  << " [--detect-every n] [--flow] [--motion-gate]" << std::endl;
+        return 1;
+    }
+    bool useLeft = false;
+    double deadlineMs = 15;  // about half a frame at 30 fps
+    bool show = true;
+    bool csv = false;
+    bool useDepth = false;
+    cv::Size partSize(928, 800);
+    PinholeIntrinsics intrinsics;
+    bool defaultIntrinsics = true;
+    bool bodyFrame = false;
+    float body[4] = {0, 0, 0, 0};
+    TrackerOptions tracking;
+    tracking.interval = 1;
+    bool useGate = false;
+    for (int i = 4; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--left") {
+            useLeft = true;
+        } else if (arg == "--deadline" && i + 1 < argc) {
+            deadlineMs = std::stod(argv[++i]);
+        } else if (arg == "--no-show") {
+            show = false;
+        } else if (arg == "--csv") {
+            csv = true;
+        } else if (arg == "--depth") {
+            useDepth = true;
+        } else if (arg == "--part-size" && i + 1 < argc) {
+            sscanf(argv[++i], "%dx%d", &partSize.width, &partSize.height);
+        } else if (arg == "--intrinsics" && i + 1 < argc) {
+            defaultIntrinsics = sscanf(argv[++i], "%f,%f,%f,%f", &intrinsics.fx, &intrinsics.fy,
+                                       &intrinsics.cx, &intrinsics.cy) != 4;
+        } else if (arg == "--body" && i + 1 < argc) {
+            bodyFrame = sscanf(argv[++i], "%f,%f,%f,%f", &body[0], &body[1], &body[2], &body[3]) == 4;
+        } else if (arg == "--detect-every" && i + 1 < argc) {
+            tracking.interval = std::max(std::stoi(argv[++i]), 1);
+        } else if (arg == "--flow") {
+            tracking.use_flow = true;
+        } else if (arg == "--motion-gate") {
+            useGate = true;
+        }
+    }
+
     boost::asio::io_service io_service;
     boost::asio::ip::udp::socket socket(io_service);
     socket.open(boost::asio::ip::udp::v4());
+    boost::asio::ip::udp::endpoint endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 12346);
 
-    ObjectDetector detector(argv[1], argv[2], argv[3]);
-    // Prepare our context and sockets
-    zmq::context_t context(1);
-    zmq::socket_t socket1(context, ZMQ_REQ);
-    zmq::socket_t socket2(context, ZMQ_REQ);
+    // the server crops the left image before encoding, only the region detection looks at is sent
+    std::vector<Camera> cameras(1);
+    cameras[0].name = "front";
+    cameras[0].endpoint = "tcp://192.168.123.13:25661";
+    cameras[0].depthEndpoint = "tcp://192.168.123.13:25663";
+    cameras[0].req.parts = FRAME_PART_LEFT;
+    cameras[0].req.roi_x = 100; //for go1-aka
+    cameras[0].req.roi_y = 70;
+    cameras[0].req.roi_width = 730;
+    cameras[0].req.roi_height = 730;
+    if (useLeft) {
+        Camera left;
+        left.name = "left";
+        left.endpoint = "tcp://192.168.123.14:25661";
+        left.depthEndpoint = "tcp://192.168.123.14:25663";
+        left.req.parts = FRAME_PART_LEFT;
+        cameras.push_back(left);
+    }
 
+    // Generate time stamped folder names and create the directories
+    for (Camera& camera : cameras) {
+        camera.folder = getTimeStampedFolderName() + "_" + camera.name;
+        std::filesystem::create_directories(camera.folder);
+    }
+
+    ObjectDetector detector(argv[1], argv[2], argv[3], (int)cameras.size());
+    Pipeline pipeline(cameras, detector, std::chrono::microseconds((int64_t)(deadlineMs * 1000)), tracking,
+                      useGate);
 
     std::cout << "Connecting to servers…" << std::endl;
-    socket1.connect("tcp://192.168.123.13:25661");
-#if USE_LEFT_CAMERA == 1
-    //socket2.connect("tcp://192.168.123.14:25661");
-#endif
-
-    // Generate time stamped folder name and create the directory
-    std::string folderName1 = getTimeStampedFolderName() + "_front";
-    std::string folderName2 = getTimeStampedFolderName() + "_left";
-    std::filesystem::create_directories(folderName1);
-    std::filesystem::create_directories(folderName2);
-
-    int counter = 0;
-
-    while (true) {
-        cv::Mat capimg = receiveImage(socket1, "server 1 (front)");
-        cv::Mat img1 = cv::Mat(capimg, cv::Rect(100, 70, 730, 730)); //for go1-aka
-        auto objects = detect_and_send(detector, socket, img1, "camera_front");
-
-#if USE_LEFT_CAMERA == 1
-        cv::Mat img2 = receiveImage(socket2, "server 2 (left)");
-        detectObjects(detector, img2);
-#endif
-
-        // Save the image from server 1
-        std::stringstream ss1;
-        ss1 << folderName1 << "/image_" << std::setfill('0') << std::setw(5) << counter << ".jpg";
-        if (!cv::imwrite(ss1.str(), capimg)) {
-            std::cerr << "Could not write image to file: " << ss1.str() << std::endl;
-            break;
+    zmq::context_t context(1);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < cameras.size(); i++) {
+        threads.emplace_back(&Pipeline::receive, &pipeline, std::ref(context), (int)i);
+        if (useDepth) {
+            threads.emplace_back(&Pipeline::receiveDepth, &pipeline, std::ref(context), (int)i);
         }
-        std::cout << "Image received from server 1 (front) and saved to " << ss1.str() << std::endl;
+    }
+    threads.emplace_back(&Pipeline::decode, &pipeline);
+    threads.emplace_back(&Pipeline::infer, &pipeline);
 
-        cv::Mat img = img1;
-#if USE_LEFT_CAMERA == 1
-        // Save the image from server 2
-        std::stringstream ss2;
-        ss2 << folderName2 << "/image_" << std::setfill('0') << std::setw(5) << counter << ".jpg";
-        if (!cv::imwrite(ss2.str(), img2)) {
-            std::cerr << "Could not write image to file: " << ss2.str() << std::endl;
+    // output stage, on the main thread for HighGUI
+    Result result;
+    DetectionDatagram datagram;
+    BoxDepthEstimator estimator(intrinsics);
+    if (bodyFrame) {
+        estimator.setBodyTransform(BoxDepthEstimator::cameraToBody(body[3]), cv::Vec3f(body[0], body[1], body[2]));
+    }
+    const int64_t depthToleranceUs = 50000;  // depth and image of the same capture, give or take a frame
+    DepthFrame depth;
+    cv::Mat display;
+    double latencySum = 0, latencyMax = 0;
+    uint64_t latencyCount = 0;
+    int64_t reportUs = wallClockUs();
+    while (pipeline.running) {
+        if (pipeline.outputQueue.pop(result, std::chrono::milliseconds(100))) {
+            double t0 = wallClockUs();
+            const Camera& camera = cameras[result.camera];
+            result.depths.clear();
+            if (useDepth && !result.objects.empty() &&
+                pipeline.depthCaches[result.camera].find(result.capture_us, depthToleranceUs, depth)) {
+                estimateDepths(estimator, defaultIntrinsics, depth, partSize, result);
+            }
+            if (csv) {
+                send_detections_csv(socket, endpoint, result.objects, "camera_" + camera.name);
+            } else {
+                sendDetections(socket, endpoint, datagram, result, bodyFrame);
+            }
+            if (show) {
+                drawDetections(result.image, result.objects, result.depths);
+                cv::resize(result.image, display, cv::Size(), 0.5, 0.5);
+                cv::imshow("Received Image (" + camera.name + ")", display);
+            }
+            int64_t done = wallClockUs();
+            pipeline.times.add(pipeline.outputStage, done - t0);
+            latencySum += done - result.receive_us;
+            latencyMax = std::max(latencyMax, (double)(done - result.receive_us));
+            latencyCount++;
+            pipeline.freeResults.push(std::move(result));
+        }
+        if (show && cv::waitKey(1) >= 0) {
             break;
         }
-        std::cout << "Image received from server 2 (left) and saved to " << ss2.str() << std::endl;
-
-        // Combine the two images horizontally
-        cv::hconcat(img1, img2, img);
-#endif
-
-        for (const auto &det : objects) {
-            int left  = (det.bbox.x - det.bbox.w / 2) * img.cols;
-            int right = (det.bbox.x + det.bbox.w / 2) * img.cols;
-            int top   = (det.bbox.y - det.bbox.h / 2) * img.rows;
-            int bot   = (det.bbox.y + det.bbox.h / 2) * img.rows;
-
-            cv::rectangle(img, cv::Point(left, top), cv::Point(right, bot), cv::Scalar(0, 255, 0), 3);
-            std::string label = det.name + " " + std::to_string((int)(det.confidence * 100)) + "%";
-            cv::putText(img, label, cv::Point(left, top - 5), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 0), 2);
+        if (wallClockUs() - reportUs >= 5000000) {
+            reportUs = wallClockUs();
+            pipeline.times.print();
+            printf("  %-12s %8.2f /%8.2f  (reply received to output done)\n", "latency",
+                   latencyCount ? latencySum / latencyCount / 1000.0 : 0.0, latencyMax / 1000.0);
+            latencySum = latencyMax = 0;
+            latencyCount = 0;
         }
-
-
-        // Show the combined image
-        cv::resize(img, img, cv::Size(), 0.5, 0.5);
-        cv::imshow("Received Images (front | left)", img);
-
-        counter++;
-
-        if (cv::waitKey(50) >= 0) break;
-        //if (cv::waitKey(30) >= 0) break;
-
     }
 
+    pipeline.stop();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    pipeline.times.print();
+    pipeline.batcher.printStats();
+    for (size_t i = 0; i < cameras.size(); i++) {
+        pipeline.trackers[i].printStats(cameras[i].name.c_str());
+        if (useGate) {
+            pipeline.gates[i].printStats(cameras[i].name.c_str());
+        }
+    }
+    pipeline.recorder.printStats();
     return 0;
 }
-
@@ -6,8 +6,12 @@
 #include <sstream>
 #include <iomanip>
 #include <filesystem>
-#include <thread>
+#include <vector>
 #include <chrono>
+#include "frame_protocol.hh"
+#include "frame_recorder.hh"
+#include "jpeg_decoder.hh"
+#include "multi_camera_receiver.hh"
 
 std::string getTimeStampedFolderName() {
     // Get current time
@@ -26,99 +30,102 @@ std::string getTimeStampedFolderName() {
     return ss.str();
 }
 
-int main() {
-    // Prepare our context and sockets
+// usage: recv_image_dual [--stream] [--tolerance ms] [--no-show] [--scale 1|2|4]
+// Receives from the front and left servers at the same time and pairs their
+// frames by capture time stamp. With --stream the servers' PUB streams are
+// used (image_server --stream), otherwise left images are requested. The
+// received JPEGs are saved as they are; --no-show skips decoding, --scale
+// decodes at reduced size for display.
+int main(int argc, char* argv[]) {
+    bool stream = false;
+    double toleranceMs = 20;  // a bit more than half a frame at 30 fps
+    bool show = true;
+    int scale = 1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--stream") {
+            stream = true;
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            toleranceMs = std::stod(argv[++i]);
+        } else if (arg == "--no-show") {
+            show = false;
+        } else if (arg == "--scale" && i + 1 < argc) {
+            scale = std::atoi(argv[++i]);
+        }
+    }
+
     zmq::context_t context(1);
-    zmq::socket_t socket1(context, ZMQ_REQ);
-    zmq::socket_t socket2(context, ZMQ_REQ);
+    MultiCameraReceiver receiver(context, (int64_t)(toleranceMs * 1000));
 
     std::cout << "Connecting to servers…" << std::endl;
-    socket1.connect("tcp://192.168.123.13:25661");
-    socket2.connect("tcp://192.168.123.14:25661");
+    if (stream) {
+        receiver.addStream("front", "tcp://192.168.123.13:25662");
+        receiver.addStream("left", "tcp://192.168.123.14:25662");
+    } else {
+        FrameRequest req;
+        req.parts = FRAME_PART_LEFT;
+        receiver.addServer("front", "tcp://192.168.123.13:25661", req);
+        receiver.addServer("left", "tcp://192.168.123.14:25661", req);
+    }
 
     // Generate time stamped folder name and create the directory
-    std::string folderName1 = getTimeStampedFolderName() + "_front";
-    std::string folderName2 = getTimeStampedFolderName() + "_left";
-    std::filesystem::create_directories(folderName1);
-    std::filesystem::create_directories(folderName2);
-
-    int counter = 0;
+    std::vector<std::string> folders;
+    for (size_t i = 0; i < receiver.size(); i++) {
+        folders.push_back(getTimeStampedFolderName() + "_" + receiver.name(i));
+        std::filesystem::create_directories(folders.back());
+    }
 
+    FrameRecorder recorder;
+    FrameBundle bundle;
+    JpegDecoder decoder;
+    cv::Mat img;  // all left images side by side, decoded in place and reused across bundles
     while (true) {
-        // Send request to server 1
-        zmq::message_t request1(6);
-        memcpy(request1.data(), "Hello", 6);
-        std::cout << "Sending request to server 1 (front)…" << std::endl;
-        socket1.send(request1);
-
-        // Get the reply from server 1 (image data).
-        zmq::message_t reply1;
-        socket1.recv(&reply1);
-
-        // Assuming the server responds with a jpeg image, load it into OpenCV
-        std::vector<char> data1(static_cast<char*>(reply1.data()), static_cast<char*>(reply1.data()) + reply1.size());
-        cv::Mat img1 = cv::imdecode(cv::Mat(data1), cv::IMREAD_COLOR);
-
-        if (img1.empty()) {
-            std::cerr << "Image from server 1 (front) is empty or corrupted." << std::endl;
-            break;
+        if (!receiver.poll(bundle, std::chrono::milliseconds(2000))) {
+            std::cerr << "No synchronized frames received." << std::endl;
+            receiver.printStats(stderr);
+            continue;
         }
 
-        // Save the image from server 1
-        std::stringstream ss1;
-        ss1 << folderName1 << "/image_" << std::setfill('0') << std::setw(5) << counter << ".jpg";
-        if (!cv::imwrite(ss1.str(), img1)) {
-            std::cerr << "Could not write image to file: " << ss1.str() << std::endl;
-            break;
+        std::cout << "Bundle " << receiver.stats().bundles << ", capture time offset (left - front): "
+                  << (bundle.frames[1].header.capture_us - bundle.frames[0].header.capture_us) / 1000.0 << " ms" << std::endl;
+        if (receiver.stats().bundles % 100 == 0) {
+            receiver.printStats();
+            recorder.printStats();
         }
 
-        std::cout << "Image received from server 1 (front) and saved to " << ss1.str() << std::endl;
-
-
-        // Send request to server 2
-        zmq::message_t request2(6);
-        memcpy(request2.data(), "Hello", 6);
-        std::cout << "Sending request to server 2 (left)…" << std::endl;
-        socket2.send(request2);
-
-        // Get the reply from server 2 (image data).
-        zmq::message_t reply2;
-        socket2.recv(&reply2);
-
-        // Assuming the server responds with a jpeg image, load it into OpenCV
-        std::vector<char> data2(static_cast<char*>(reply2.data()), static_cast<char*>(reply2.data()) + reply2.size());
-        cv::Mat img2 = cv::imdecode(cv::Mat(data2), cv::IMREAD_COLOR);
-
-        if (img2.empty()) {
-            std::cerr << "Image from server 2 (left) is empty or corrupted." << std::endl;
-            break;
+        bool ok = true;
+        int x = 0;
+        for (size_t i = 0; i < bundle.frames.size(); i++) {
+            if (show) {
+                const FrameMessage& frame = bundle.frames[i];
+                cv::Size part = JpegDecoder::scaledSize(cv::Size(frame.header.width, frame.header.height), scale);
+                if (i == 0) {
+                    img.create(part.height, part.width * (int)bundle.frames.size(), CV_8UC3);
+                }
+                if (part.height != img.rows || x + part.width > img.cols ||
+                    !decoder.decodeInto(frame.left, frame.header.left_bytes, img, cv::Rect(x, 0, part.width, part.height), scale)) {
+                    std::cerr << "Image from " << receiver.name(i) << " is empty or corrupted." << std::endl;
+                    ok = false;
+                }
+                x += part.width;
+            }
+
+            // Save the received JPEG as it is
+            std::stringstream ss;
+            ss << folders[i] << "/image_" << bundle.frames[i].header.capture_us;
+            recordFrame(recorder, std::move(bundle.frames[i]), ss.str());
         }
-
-        // Save the image from server 2
-        std::stringstream ss2;
-        ss2 << folderName2 << "/image_" << std::setfill('0') << std::setw(5) << counter << ".jpg";
-        if (!cv::imwrite(ss2.str(), img2)) {
-            std::cerr << "Could not write image to file: " << ss2.str() << std::endl;
-            break;
+        if (!show || !ok) {
+            continue;
         }
 
-        std::cout << "Image received from server 2 (left) and saved to " << ss2.str() << std::endl;
-
-        // Combine the two images horizontally
-        cv::Mat img;
-        cv::hconcat(img1, img2, img);
-
         // Show the combined image
         cv::imshow("Received Images (front | left)", img);
 
-        counter++;
-
-        if (cv::waitKey(30) >= 0) break;
-
-        // Wait for 1 second
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        if (cv::waitKey(1) >= 0) break;
     }
 
+    receiver.printStats();
+    recorder.printStats();
     return 0;
 }
-
@@ -6,6 +6,11 @@
 #include <sstream>
 #include <iomanip>
 #include <filesystem>
+#include <memory>
+#include "credit_client.hh"
+#include "frame_protocol.hh"
+#include "frame_recorder.hh"
+#include "jpeg_decoder.hh"
 
 std::string getTimeStampedFolderName() {
     // Get current time
@@ -24,58 +29,129 @@ std::string getTimeStampedFolderName() {
     return ss.str();
 }
 
-int main() {
+// usage: recv_image_test [server_ip] [--stream | --credit] [--parts left|right|both] [--no-show] [--scale 1|2|4]
+// --stream subscribes to the PUB stream of image_server (latest frame only)
+// instead of requesting every frame; the parts of the stream are chosen by
+// image_server --stream-parts. --credit uses the credit endpoint of
+// image_server --credit, which pushes frames ahead within an adaptive window.
+// Received JPEGs are saved as they are by a background recorder; with
+// --no-show they are not decoded at all, with --scale they are decoded at
+// reduced size for display.
+int main(int argc, char *argv[]) {
+    std::string server = "192.168.123.13";
+    bool stream = false;
+    bool credit = false;
+    bool show = true;
+    int scale = 1;
+    FrameRequest req;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--stream") {
+            stream = true;
+        } else if (arg == "--credit") {
+            credit = true;
+        } else if (arg == "--no-show") {
+            show = false;
+        } else if (arg == "--scale" && i + 1 < argc) {
+            scale = std::atoi(argv[++i]);
+        } else if (arg == "--parts" && i + 1 < argc) {
+            std::string parts = argv[++i];
+            req.parts = parts == "both" ? FRAME_PART_BOTH : parts == "right" ? FRAME_PART_RIGHT : FRAME_PART_LEFT;
+        } else {
+            server = arg;
+        }
+    }
+
     // Prepare our context and socket
     zmq::context_t context(1);
-    zmq::socket_t socket(context, ZMQ_REQ);
+    zmq::socket_t socket(context, stream ? ZMQ_SUB : ZMQ_REQ);
+    std::unique_ptr<CreditClient> creditClient;
 
     std::cout << "Connecting to server…" << std::endl;
-    socket.connect("tcp://192.168.123.13:25661");
+    if (credit) {
+        creditClient.reset(new CreditClient(context, "tcp://" + server + ":25665", req));
+    } else if (stream) {
+        socket.set(zmq::sockopt::conflate, 1);  // keep only the newest frame
+        socket.set(zmq::sockopt::subscribe, "");
+        socket.connect("tcp://" + server + ":25662");
+    } else {
+        socket.connect("tcp://" + server + ":25661");
+    }
 
-    cv::namedWindow("Received Images", cv::WINDOW_AUTOSIZE);
+    if (show) {
+        cv::namedWindow("Received Images", cv::WINDOW_AUTOSIZE);
+    }
 
     // Generate time stamped folder name and create the directory
     std::string folderName = getTimeStampedFolderName();
     std::filesystem::create_directories(folderName);
-
-    int counter = 0;
-
-    while (true) {
-        // Sending request
-        zmq::message_t request(6);
-        memcpy(request.data(), "Hello", 6);
-        std::cout << "Sending request…" << std::endl;
-        socket.send(request);
-
-        // Get the reply (image data).
-        zmq::message_t reply;
-        socket.recv(&reply);
-
-        // Assuming the server responds with a jpeg image, load it into OpenCV
-        std::vector<char> data(static_cast<char*>(reply.data()), static_cast<char*>(reply.data()) + reply.size());
-        cv::Mat img = cv::imdecode(cv::Mat(data), cv::IMREAD_COLOR);
-
-        if (img.empty()) {
-            std::cerr << "Image is empty or corrupted." << std::endl;
-            break;
+    FrameRecorder recorder;
+
+    FrameMessage frame;
+    JpegDecoder decoder;
+    cv::Mat img;  // left | right, decoded in place and reused across frames
+    for (uint64_t count = 1;; count++) {
+        if (creditClient) {
+            if (!creditClient->next(frame, std::chrono::milliseconds(2000))) {
+                std::cerr << "No frame received." << std::endl;
+                continue;
+            }
+        } else {
+            if (!stream) {
+                socket.send(zmq::buffer(&req, sizeof(req)));
+            }
+            // Each frame is a FrameHeader followed by the encoded parts
+            if (!recvFrameMessage(socket, frame)) {
+                std::cerr << "Unknown frame message." << std::endl;
+                if (stream) {
+                    continue;
+                }
+                break;
+            }
+        }
+        const FrameHeader &hdr = frame.header;
+        std::cout << "Frame " << hdr.seq << " of camera " << hdr.pos_number << " (serial " << hdr.serial_number << ")"
+                  << " latency " << (wallClockUs() - hdr.capture_us) / 1000.0 << " ms";
+        if (creditClient) {
+            std::cout << ", window " << creditClient->window() << " (rtt " << creditClient->rttMs() << " ms)";
+        }
+        std::cout << std::endl;
+
+        if (show) {
+            cv::Size part = JpegDecoder::scaledSize(cv::Size(hdr.width, hdr.height), scale);
+            int parts = (frame.left ? 1 : 0) + (frame.right ? 1 : 0);
+            img.create(part.height, part.width * parts, CV_8UC3);
+            bool ok = parts > 0;
+            int x = 0;
+            if (frame.left) {
+                ok = ok && decoder.decodeInto(frame.left, hdr.left_bytes, img, cv::Rect(x, 0, part.width, part.height), scale);
+                x += part.width;
+            }
+            if (frame.right) {
+                ok = ok && decoder.decodeInto(frame.right, hdr.right_bytes, img, cv::Rect(x, 0, part.width, part.height), scale);
+            }
+
+            if (!ok) {
+                std::cerr << "Image is empty or corrupted." << std::endl;
+                break;
+            }
         }
 
-        // Show the image
-        cv::imshow("Received Images", img);
-
-        // Save the image
+        // Save the received JPEGs, named by the capture time stamp of the server
         std::stringstream ss;
-        ss << folderName << "/image_" << std::setfill('0') << std::setw(5) << counter << ".jpg";
-        if (!cv::imwrite(ss.str(), img)) {
-            std::cerr << "Could not write image to file: " << ss.str() << std::endl;
-            break;
+        ss << folderName << "/image_" << hdr.capture_us;
+        recordFrame(recorder, std::move(frame), ss.str());
+        if (count % 100 == 0) {
+            recorder.printStats();
         }
 
-        std::cout << "Image received and saved to " << ss.str() << std::endl;
-        counter++;
-
-        if (cv::waitKey(30) >= 0) break;
+        if (show) {
+            // Show the image
+            cv::imshow("Received Images", img);
+            if (cv::waitKey(30) >= 0) break;
+        }
     }
 
+    recorder.printStats();
     return 0;
 }
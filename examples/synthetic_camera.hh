@@ -0,0 +1,208 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// Stand-in for UnitreeCamera when no stereo camera is attached: produces
+// raw side-by-side frames at the configured rate on a capture thread, either
+// from a moving synthetic texture or by replaying a recorded video / image
+// (looped). Implements the subset of the StereoCamera API the servers use;
+// stereo outputs are a synthetic scene (a tilted, rippled plane).
+class SyntheticCamera {
+public:
+    explicit SyntheticCamera(const std::string &replay_file = "")
+        : replay_file_(replay_file)
+    {
+        if (!replay_file_.empty()) {
+            replay_.open(replay_file_);
+            opened_ = replay_.isOpened();
+        }
+    }
+
+    ~SyntheticCamera() { stopCapture(); }
+
+    bool isOpened() const { return opened_; }
+    int getPosNumber() const { return 0; }
+    int getSerialNumber() const { return 0; }
+    float getRawFrameRate() const { return fps_; }
+    cv::Size getRawFrameSize() const { return frame_size_; }
+
+    bool setRawFrameSize(cv::Size size)
+    {
+        frame_size_ = size;
+        return true;
+    }
+
+    bool setRawFrameRate(int fps)
+    {
+        fps_ = fps > 0 ? fps : 30;
+        return true;
+    }
+
+    bool startCapture(bool = false, bool = false)
+    {
+        if (worker_.joinable()) {
+            return false;
+        }
+        running_ = true;
+        worker_ = std::thread(&SyntheticCamera::run, this);
+        return true;
+    }
+
+    bool stopCapture()
+    {
+        running_ = false;
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+        return true;
+    }
+
+    bool startStereoCompute() { return true; }
+    bool stopStereoCompute() { return true; }
+
+    // Depth of the left image of the latest frame as the SDK returns it: 8 bit
+    // gray display depth, the scene's millimetres stretched over kGrayMinMm..kGrayMaxMm.
+    bool getDepthFrame(cv::Mat &depth, bool, std::chrono::microseconds &timestamp)
+    {
+        if (!sceneDepth(mm_, timestamp)) {
+            return false;
+        }
+        mm_.convertTo(depth, CV_8U, 255.0 / (kGrayMaxMm - kGrayMinMm), -255.0 * kGrayMinMm / (kGrayMaxMm - kGrayMinMm));
+        return true;
+    }
+
+    // Calibration as StereoCamera::getCalibParams() arranges it (intrinsic, distortion, xi, rotation,
+    // translation, kfe): an ideal pinhole, kfe the 90 degree one the point cloud is projected with.
+    bool getCalibParams(std::vector<cv::Mat> &params, bool = false) const
+    {
+        cv::Size size(frame_size_.width / 2, frame_size_.height);
+        cv::Mat k = (cv::Mat_<double>(3, 3) << size.width / 2.0, 0, size.width / 2.0,
+                                               0, size.width / 2.0, size.height / 2.0,
+                                               0, 0, 1);
+        params = {k.clone(), cv::Mat::zeros(1, 4, CV_64F), cv::Mat::zeros(1, 1, CV_64F), cv::Mat::eye(3, 3, CV_64F),
+                  cv::Mat::zeros(3, 1, CV_64F), k};
+        return true;
+    }
+
+    // Point cloud (metres) of the scene back projected through a 90 degree pinhole, every other pixel.
+    bool getPointCloud(std::vector<cv::Vec3f> &pcl, std::chrono::microseconds &timestamp)
+    {
+        cv::Mat depth;
+        if (!sceneDepth(depth, timestamp)) {
+            return false;
+        }
+        float f = depth.cols / 2.0f, cx = depth.cols / 2.0f, cy = depth.rows / 2.0f;
+        pcl.clear();
+        for (int y = 0; y < depth.rows; y += 2) {
+            const uint16_t *row = depth.ptr<uint16_t>(y);
+            for (int x = 0; x < depth.cols; x += 2) {
+                float z = row[x] * 0.001f;
+                pcl.emplace_back((x - cx) * z / f, (y - cy) * z / f, z);
+            }
+        }
+        return true;
+    }
+
+    // Same contract as StereoCamera::getRawFrame: latest frame, false if none yet.
+    bool getRawFrame(cv::Mat &frame, std::chrono::microseconds &timestamp)
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (latest_.empty()) {
+            return false;
+        }
+        frame = latest_;
+        timestamp = latest_stamp_;
+        return true;
+    }
+
+private:
+    std::string replay_file_;
+    cv::VideoCapture replay_;
+    bool opened_ = true;
+    cv::Size frame_size_{1856, 800};
+    float fps_ = 30;
+
+    std::atomic<bool> running_{false};
+    std::thread worker_;
+    std::mutex lock_;
+    cv::Mat latest_;
+    std::chrono::microseconds latest_stamp_{0};
+    cv::Mat mm_;
+
+    static constexpr int kGrayMinMm = 50;   // image_server's default --depth-range
+    static constexpr int kGrayMaxMm = 1000;
+
+    // Millimetres (CV_16U) of the scene: a plane tilting away towards the bottom, rippling over time.
+    bool sceneDepth(cv::Mat &mm, std::chrono::microseconds &timestamp)
+    {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            if (latest_.empty()) {
+                return false;
+            }
+            timestamp = latest_stamp_;
+        }
+        double phase = (timestamp.count() % 2000000) * 3.14159265 / 1000000.0;
+        mm.create(frame_size_.height, frame_size_.width / 2, CV_16U);
+        for (int y = 0; y < mm.rows; ++y) {
+            uint16_t *row = mm.ptr<uint16_t>(y);
+            for (int x = 0; x < mm.cols; ++x) {
+                row[x] = (uint16_t)(400 + 500 * y / mm.rows + 80 * std::sin(x / 40.0 + phase));
+            }
+        }
+        return true;
+    }
+
+    cv::Mat nextReplayFrame()
+    {
+        cv::Mat img;
+        if (!replay_.read(img) || img.empty()) {
+            replay_.set(cv::CAP_PROP_POS_FRAMES, 0);
+            replay_.read(img);
+        }
+        if (!img.empty() && img.size() != frame_size_) {
+            cv::resize(img, img, frame_size_, 0, 0, cv::INTER_AREA);
+        }
+        return img;
+    }
+
+    void run()
+    {
+        cv::Mat texture(frame_size_.height, frame_size_.width * 2, CV_8UC3);
+        cv::randu(texture, cv::Scalar::all(0), cv::Scalar::all(255));
+        cv::GaussianBlur(texture, texture, cv::Size(7, 7), 2.0);
+
+        auto period = std::chrono::microseconds((int64_t)(1e6 / fps_));
+        auto next = std::chrono::steady_clock::now();
+        uint64_t seq = 0;
+        while (running_) {
+            cv::Mat frame;
+            if (replay_.isOpened()) {
+                frame = nextReplayFrame();
+            } else {
+                // a new buffer every frame, readers keep their shallow copies untouched
+                int shift = (int)(seq * 8 % frame_size_.width);
+                frame = texture(cv::Rect(shift, 0, frame_size_.width, frame_size_.height)).clone();
+                cv::putText(frame, std::to_string(seq), cv::Point(40, 80), cv::FONT_HERSHEY_SIMPLEX, 2.0,
+                            cv::Scalar(255, 255, 255), 3);
+            }
+            auto stamp = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch());
+            {
+                std::lock_guard<std::mutex> lock(lock_);
+                latest_ = frame;
+                latest_stamp_ = stamp;
+            }
+            seq++;
+            next += period;
+            std::this_thread::sleep_until(next);
+        }
+    }
+};
@@ -1,4 +1,14 @@
+import argparse
 import socket
+import struct
+
+# examples/detection_protocol.hh
+DETECTION_MAGIC = 0x54444355
+DETECTION_VERSION = 2
+DETECTION_TRUNCATED = 1
+DETECTION_BODY_FRAME = 2
+HEADER = struct.Struct('<IBBBBHHQq')  # magic, version, camera, flags, reserved, count, age, seq, capture_us
+RECORD = struct.Struct('<HHfffffffff')  # class_id, track_id, confidence, x, y, w, h, distance, px, py, pz
 
 def parse_message(message):
     tokens = message.split(',')
@@ -8,21 +18,58 @@ def parse_message(message):
     bbox = tuple(map(float, tokens[3:]))
     return camera_name, object_label, confidence, bbox
 
-def receive_udp_message(ip_address, port):
+def parse_datagram(data):
+    """Returns (camera, seq, capture_us, flags, age, [(class_id, track_id, confidence, bbox, distance, position), ...]) or None."""
+    if len(data) < HEADER.size:
+        return None
+    magic, version, camera, flags, _, count, age, seq, capture_us = HEADER.unpack_from(data)
+    if magic != DETECTION_MAGIC or version != DETECTION_VERSION or len(data) != HEADER.size + count * RECORD.size:
+        return None
+    objects = []
+    for i in range(count):
+        class_id, track_id, confidence, x, y, w, h, distance, px, py, pz = RECORD.unpack_from(data, HEADER.size + i * RECORD.size)
+        objects.append((class_id, track_id, confidence, (x, y, w, h), distance, (px, py, pz)))
+    return camera, seq, capture_us, flags, age, objects
+
+def receive_udp_message(ip_address, port, csv, names):
     sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
     sock.bind((ip_address, port))
     while True:
-        data, addr = sock.recvfrom(1024)
-        message = data.decode('utf-8')
-        camera_name, object_label, confidence, bbox = parse_message(message)
-        print(f"Camera: {camera_name}")
-        print(f"Object: {object_label}")
-        print(f"Confidence: {confidence}")
-        print(f"Bbox: {bbox}")
+        data, addr = sock.recvfrom(2048)
+        if csv:
+            message = data.decode('utf-8')
+            camera_name, object_label, confidence, bbox = parse_message(message)
+            print(f"Camera: {camera_name}")
+            print(f"Object: {object_label}")
+            print(f"Confidence: {confidence}")
+            print(f"Bbox: {bbox}")
+            print()
+            continue
+
+        frame = parse_datagram(data)
+        if frame is None:
+            print(f"Ignoring {len(data)} bytes from {addr}: not a detection datagram")
+            continue
+        camera, seq, capture_us, flags, age, objects = frame
+        print(f"Camera: {camera}, frame {seq}, captured {capture_us / 1e6:.6f}, "
+              f"{len(objects)} objects{' (truncated)' if flags & DETECTION_TRUNCATED else ''}"
+              f"{f', detected {age} frames ago' if age else ''}")
+        frame_name = 'body' if flags & DETECTION_BODY_FRAME else 'camera'
+        for class_id, track_id, confidence, bbox, distance, position in objects:
+            label = names[class_id] if class_id < len(names) else str(class_id)
+            where = f", Distance: {distance:.2f} m, Position ({frame_name}): {position}" if distance > 0 else ""
+            print(f"  Object: {label}, Track: {track_id}, Confidence: {confidence:.3f}, Bbox: {bbox}{where}")
         print()
 
 if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Prints the detections sent by recv_image_detect / detect_objects_uvc.')
+    parser.add_argument('--csv', action='store_true', help='senders run with --csv (former text format)')
+    parser.add_argument('--names', help='names file of the network, to print labels instead of class ids')
+    args = parser.parse_args()
+    names = []
+    if args.names:
+        with open(args.names) as f:
+            names = [line.strip() for line in f if line.strip()]
     ip_address = '127.0.0.1'
     port = 12346
-    receive_udp_message(ip_address, port)
-
+    receive_udp_message(ip_address, port, args.csv, names)
@@ -0,0 +1,388 @@
+/**
+  * @file AsyncSystemLog.hpp
+  * @brief This file is part of UnitreeCameraSDK, which declare the APIs of asynchronous log system.
+  * @details AsyncSystemLog has the same interface as SystemLog, but the caller only formats the message text
+  * and pushes a record into a lock-free ring owned by the calling thread. A background thread adds the log
+  * prefix, colors and time stamp, then writes records to stdout and the log file.
+  * @date  2026.10.19
+  * @version 1.1.0
+  * @copyright Copyright (c)2020-2021, Hangzhou Yushu Technology Stock CO.LTD. All Rights Reserved.
+  */
+
+#ifndef __ASYNC_SYSTEMLOG_HPP__
+#define __ASYNC_SYSTEMLOG_HPP__
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class AsyncSystemLog;
+
+/**
+  * @enum LogKind
+  * @brief kind of log record, decides record prefix, color and output level
+  */
+enum LogKind {
+    LOG_RUNTIME_ERROR = 0,  ///< [ERROR], red
+    LOG_RUNTIME_INFO,       ///< [INFO], green
+    LOG_RUNTIME_WARNING,    ///< [WARNING], yellow
+    LOG_DEBUG_WARNING,      ///< [DEBUG_WARNING], cyan
+    LOG_DEBUG_INFO,         ///< [DEBUG_INFO], white
+    LOG_DEBUG_ERROR,        ///< [DEBUG_ERROR], magenta
+    LOG_KIND_NUM
+};
+
+/**
+  * @class AsyncLogBackend
+  * @brief background writer of AsyncSystemLog
+  * @details every producer thread owns a single producer single consumer ring, so pushing a record never
+  * locks or blocks. If the ring is full, the record is dropped and counted by its AsyncSystemLog.
+  */
+class AsyncLogBackend
+{
+public:
+    static const size_t MaxTextLength = 232;
+    typedef struct LogRecord{
+        AsyncSystemLog *log;         ///< log which the record belongs to
+        int64_t timeUs;              ///< time since 1970-01-01 00:00:00, unit is microseconds
+        int kind;                    ///< LogKind
+        char text[MaxTextLength];    ///< formatted message text
+    }LogRecordType;
+
+private:
+    struct Ring{
+        std::vector<LogRecordType> slots;
+        size_t mask;
+        alignas(64) std::atomic<size_t> head;   ///< written by producer
+        alignas(64) std::atomic<size_t> tail;   ///< written by background thread
+        std::atomic<bool> closed;
+        explicit Ring(size_t capacity) : slots(capacity), mask(capacity - 1), head(0), tail(0), closed(false){}
+    };
+    struct RingHandle{
+        std::shared_ptr<Ring> ring;
+        ~RingHandle(){
+            if(ring)
+                ring->closed.store(true, std::memory_order_release);
+        }
+    };
+
+    std::atomic<bool> m_running;
+    size_t m_ringCapacity;
+    std::mutex m_registryLock;
+    std::vector<std::shared_ptr<Ring> > m_rings;
+    std::thread m_worker;
+
+    AsyncLogBackend(void) : m_running(true), m_ringCapacity(1024){
+        m_worker = std::thread(&AsyncLogBackend::run, this);
+    }
+    AsyncLogBackend(const AsyncLogBackend&) = delete;
+    AsyncLogBackend& operator=(const AsyncLogBackend&) = delete;
+
+public:
+    ~AsyncLogBackend(){
+        m_running.store(false, std::memory_order_release);
+        if(m_worker.joinable())
+            m_worker.join();
+    }
+    /**
+      * @fn instance
+      * @brief get the process wide backend, the background thread starts at the first call
+      */
+    static AsyncLogBackend& instance(void){
+        static AsyncLogBackend backend;
+        return backend;
+    }
+    /**
+      * @fn setRingCapacity
+      * @brief set record number of the ring of every producer thread
+      * @param[in] capacity record number, rounded up to power of 2, default 1024 (256KB)
+      * @attention only threads which have not logged yet use the new capacity
+      */
+    void setRingCapacity(size_t capacity){
+        size_t n = 2;
+        while(n < capacity)
+            n <<= 1;
+        std::lock_guard<std::mutex> lock(m_registryLock);
+        m_ringCapacity = n;
+    }
+    /**
+      * @fn tryPush
+      * @brief format a record into the ring of calling thread
+      * @return true or false, if the ring is full return false and nothing is formatted
+      */
+    bool tryPush(AsyncSystemLog *log, int kind, const char *format, va_list args){
+        Ring *ring = localRing();
+        size_t head = ring->head.load(std::memory_order_relaxed);
+        if(head - ring->tail.load(std::memory_order_acquire) > ring->mask)
+            return false;
+
+        LogRecordType &rec = ring->slots[head & ring->mask];
+        rec.log = log;
+        rec.kind = kind;
+        rec.timeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::system_clock::now().time_since_epoch()).count();
+        vsnprintf(rec.text, MaxTextLength, format, args);
+        ring->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    /**
+      * @fn flush
+      * @brief wait until records pushed before this call are written
+      */
+    void flush(void){
+        std::vector<std::pair<std::shared_ptr<Ring>, size_t> > targets;
+        {
+            std::lock_guard<std::mutex> lock(m_registryLock);
+            for(size_t i = 0; i < m_rings.size(); i++)
+                targets.push_back(std::make_pair(m_rings[i], m_rings[i]->head.load(std::memory_order_acquire)));
+        }
+        for(size_t i = 0; i < targets.size(); i++){
+            while(targets[i].first->tail.load(std::memory_order_acquire) < targets[i].second)
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+
+private:
+    Ring* localRing(void){
+        static thread_local RingHandle handle;
+        if(!handle.ring){
+            std::lock_guard<std::mutex> lock(m_registryLock);
+            handle.ring = std::make_shared<Ring>(m_ringCapacity);
+            m_rings.push_back(handle.ring);
+        }
+        return handle.ring.get();
+    }
+
+    size_t drain(void);
+    void run(void){
+        int idleUs = 100;
+        while(true){
+            bool running = m_running.load(std::memory_order_acquire);
+            if(drain() > 0){
+                idleUs = 100;
+                continue;
+            }
+            if(!running)
+                break;
+            std::this_thread::sleep_for(std::chrono::microseconds(idleUs));
+            idleUs = idleUs < 10000 ? idleUs * 2 : 10000;
+        }
+    }
+};
+
+/**
+  * @class AsyncSystemLog
+  * @brief asynchronous log system, a drop-in replacement of SystemLog for hot paths
+  * @details callers never do stdout or file I/O and never block. Records which can not be queued are
+  * dropped, the background thread reports the dropped number when the ring has room again.
+  */
+class AsyncSystemLog
+{
+    friend class AsyncLogBackend;
+private:
+    std::atomic<int> m_logLevel;
+    std::string m_logName;
+    std::string m_logFileName;
+    FILE *m_logFile = nullptr;
+    std::mutex m_fileLock;
+    std::atomic<uint64_t> m_dropped;
+    uint64_t m_reportedDropped = 0;   ///< only accessed by background thread
+
+public:
+    /**
+      * @fn AsyncSystemLog
+      * @brief AsyncSystemLog constructor
+      * @param[in] logName the name of special system
+      * @attention output information starts with "logName"
+      */
+    AsyncSystemLog(std::string logName) : m_logLevel(1), m_logName(logName), m_dropped(0){
+        AsyncLogBackend::instance();
+    }
+    /**
+      * @fn ~AsyncSystemLog
+      * @brief AsyncSystemLog destructor
+      * @details wait until all queued records of this log are written, then close log file
+      */
+    ~AsyncSystemLog(){
+        AsyncLogBackend::instance().flush();
+        std::lock_guard<std::mutex> lock(m_fileLock);
+        if(m_logFile != nullptr)
+            fclose(m_logFile);
+    }
+
+public:
+    /**
+      * @fn setLogLevel
+      * @brief set system ouput log level
+      * @param[in] level 1 running information output, 2 running and debug infomation output
+      */
+    void setLogLevel(int level){ m_logLevel.store(level, std::memory_order_relaxed); }
+    /**
+      * @fn getLogLevel
+      * @brief get system ouput log level
+      */
+    int getLogLevel(void) const{ return m_logLevel.load(std::memory_order_relaxed); }
+    /**
+      * @fn droppedCount
+      * @brief get the number of records dropped because the ring of producer thread was full
+      */
+    uint64_t droppedCount(void) const{ return m_dropped.load(std::memory_order_relaxed); }
+    /**
+      * @fn flush
+      * @brief wait until records queued before this call are written
+      */
+    void flush(void){ AsyncLogBackend::instance().flush(); }
+
+    /**
+      * @fn runTimeError
+      * @brief output running error infomation, color: red
+      * @details output format [logName][ERROR] info
+      * @attention use it like printf()
+      */
+    void runTimeError(const char *format,...){ va_list args; va_start(args, format); push(LOG_RUNTIME_ERROR, format, args); va_end(args); }
+    /**
+      * @fn runTimeInfo
+      * @brief output running infomation, color: green
+      * @details output format [logName][INFO] info
+      * @attention use it like printf()
+      */
+    void runTimeInfo(const char *format,...){ va_list args; va_start(args, format); push(LOG_RUNTIME_INFO, format, args); va_end(args); }
+    /**
+      * @fn runTimeWarning
+      * @brief output running warning infomation, color: yellow
+      * @details output format [logName][WARNING] info
+      * @attention use it like printf()
+      */
+    void runTimeWarning(const char *format,...){ va_list args; va_start(args, format); push(LOG_RUNTIME_WARNING, format, args); va_end(args); }
+    /**
+      * @fn debugTimeWarning
+      * @brief output debug warning infomation, color: cyan
+      * @details output format [logName][DEBUG_WARNING] info
+      * @attention use it like printf()
+      */
+    void debugTimeWarning(const char *format,...){ va_list args; va_start(args, format); push(LOG_DEBUG_WARNING, format, args); va_end(args); }
+    /**
+      * @fn debugTimeInfo
+      * @brief output debug infomation, color: white
+      * @details output format [logName][DEBUG_INFO] info
+      * @attention use it like printf()
+      */
+    void debugTimeInfo(const char *format,...){ va_list args; va_start(args, format); push(LOG_DEBUG_INFO, format, args); va_end(args); }
+    /**
+      * @fn debugTimeError
+      * @brief output debug error infomation, color: magenta
+      * @details output format [logName][DEBUG_ERROR] info
+      * @attention use it like printf()
+      */
+    void debugTimeError(const char *format,...){ va_list args; va_start(args, format); push(LOG_DEBUG_ERROR, format, args); va_end(args); }
+    /**
+      * @fn saveLog
+      * @brief save system log to a file, default file name: RunningLog.txt (the same as SystemLog)
+      */
+    void saveLog(void){ saveLogToFile("RunningLog.txt"); }
+    /**
+      * @fn saveLogToFile
+      * @brief save system log to a designated file
+      * @details records are appended to the file by background thread
+      * @param[in] fileName
+      */
+    void saveLogToFile(std::string fileName){
+        std::lock_guard<std::mutex> lock(m_fileLock);
+        if(m_logFile != nullptr)
+            fclose(m_logFile);
+        m_logFileName = fileName;
+        m_logFile = fopen(fileName.c_str(), "a");
+    }
+
+    /**
+      * @fn isEnabled
+      * @brief tell whether a record of this kind passes current log level
+      */
+    bool isEnabled(int kind) const{
+        return kind < LOG_DEBUG_WARNING || m_logLevel.load(std::memory_order_relaxed) >= 2;
+    }
+    /**
+      * @fn push
+      * @brief va_list version of the output functions
+      */
+    void push(int kind, const char *format, va_list args){
+        if(!isEnabled(kind))
+            return;
+        if(!AsyncLogBackend::instance().tryPush(this, kind, format, args))
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    void write(const AsyncLogBackend::LogRecordType &rec){
+        static const char *tags[LOG_KIND_NUM] = {
+            "ERROR", "INFO", "WARNING", "DEBUG_WARNING", "DEBUG_INFO", "DEBUG_ERROR"
+        };
+        static const char *colors[LOG_KIND_NUM] = {
+            "\033[1m\033[31m", "\033[32m", "\033[1m\033[33m", "\033[36m", "\033[1m\033[37m", "\033[35m"
+        };
+
+        uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+        if(dropped != m_reportedDropped){
+            fprintf(stdout, "\033[1m\033[33m[%s][WARNING] %llu log records dropped\n\033[0m",
+                    m_logName.c_str(), (unsigned long long)(dropped - m_reportedDropped));
+            m_reportedDropped = dropped;
+        }
+
+        fprintf(stdout, "%s[%s][%s] %s\033[0m", colors[rec.kind], m_logName.c_str(), tags[rec.kind], rec.text);
+
+        std::lock_guard<std::mutex> lock(m_fileLock);
+        if(m_logFile != nullptr){
+            size_t len = strlen(rec.text);
+            const char *newline = (len > 0 && rec.text[len - 1] == '\n') ? "" : "\n";
+            time_t sec = (time_t)(rec.timeUs / 1000000);
+            struct tm tmv;
+            localtime_r(&sec, &tmv);
+            char stamp[32];
+            strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tmv);
+            fprintf(m_logFile, "%s.%06d [%s][%s] %s%s", stamp, (int)(rec.timeUs % 1000000),
+                    m_logName.c_str(), tags[rec.kind], rec.text, newline);
+            fflush(m_logFile);
+        }
+    }
+};
+
+inline size_t AsyncLogBackend::drain(void){
+    std::vector<std::shared_ptr<Ring> > rings;
+    {
+        std::lock_guard<std::mutex> lock(m_registryLock);
+        for(size_t i = 0; i < m_rings.size();){
+            if(m_rings[i]->closed.load(std::memory_order_acquire) &&
+               m_rings[i]->tail.load(std::memory_order_relaxed) == m_rings[i]->head.load(std::memory_order_acquire)){
+                m_rings.erase(m_rings.begin() + i);
+                continue;
+            }
+            rings.push_back(m_rings[i]);
+            i++;
+        }
+    }
+
+    size_t written = 0;
+    for(size_t i = 0; i < rings.size(); i++){
+        Ring *ring = rings[i].get();
+        size_t tail = ring->tail.load(std::memory_order_relaxed);
+        size_t head = ring->head.load(std::memory_order_acquire);
+        for(; tail != head; tail++){
+            const LogRecordType &rec = ring->slots[tail & ring->mask];
+            rec.log->write(rec);
+            ring->tail.store(tail + 1, std::memory_order_release);
+            written++;
+        }
+    }
+    if(written > 0)
+        fflush(stdout);
+    return written;
+}
+
+#endif //__ASYNC_SYSTEMLOG_HPP__
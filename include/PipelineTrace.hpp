@@ -0,0 +1,440 @@
+/**
+  * @file PipelineTrace.hpp
+  * @brief This file is part of UnitreeCameraSDK, which declare the APIs of pipeline stage tracing.
+  * @details Begin/end events of every pipeline stage are recorded per frame into per-thread lock-free buffers,
+  * then flushed to a Chrome trace-event JSON file which can be opened by Perfetto (ui.perfetto.dev) or chrome://tracing.
+  * Tracing is toggled at runtime and only records inside a bounded time window with bounded memory.
+  * @date  2026.10.19
+  * @version 1.1.0
+  * @copyright Copyright (c)2020-2021, Hangzhou Yushu Technology Stock CO.LTD. All Rights Reserved.
+  */
+
+#ifndef __PIPELINE_TRACE_HPP__
+#define __PIPELINE_TRACE_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+  * @enum TraceStage
+  * @brief stereo pipeline stages with a predefined trace event name
+  */
+enum TraceStage {
+    TRACE_CAPTURE = 0,   ///< camera frame capturing
+    TRACE_DECODE,        ///< frame decoding
+    TRACE_RECTIFY,       ///< image rectification
+    TRACE_DISPARITY,     ///< disparity computation
+    TRACE_DEPTH,         ///< depth image generation
+    TRACE_POINT_CLOUD,   ///< point cloud generation
+    TRACE_ENCODE,        ///< image encoding
+    TRACE_SHM_PUBLISH,   ///< share memory or network publishing
+    TRACE_STAGE_NUM
+};
+
+/**
+  * @class PipelineTracer
+  * @brief this class records pipeline stage events and writes them as Chrome trace-event JSON
+  * @details every thread owns a fixed size event buffer, only the owner thread writes it, so recording
+  * an event is wait free. When a buffer is full, new events are dropped and counted instead of growing memory.
+  * Buffers of exited threads are reused by new threads, which append to the events left in them, and at most
+  * maxThreads buffers exist; events of threads which find no buffer with room are dropped and counted too.
+  */
+class PipelineTracer
+{
+public:
+    typedef struct TraceEvent{
+        const char *name;   ///< stage name, must be a string with static storage duration
+        uint64_t frameId;   ///< frame sequence the stage works on
+        int64_t beginUs;    ///< begin time since tracer creation, unit is microseconds
+        int64_t durationUs; ///< stage duration, unit is microseconds
+    }TraceEventType;
+
+private:
+    struct ThreadBuffer{
+        std::vector<TraceEventType> events;
+        std::atomic<uint32_t> count;
+        std::atomic<uint32_t> session;
+        std::atomic<uint32_t> dropped;
+        int threadIndex;
+        std::string threadName;
+        std::atomic<uint32_t> ownerBegin;   ///< first event of the current owner thread
+        bool inUse;         ///< owned by a running thread, guarded by m_registryLock
+        struct PastOwner{
+            uint32_t session;
+            uint32_t begin, end;            ///< its events
+            int threadIndex;
+            std::string threadName;
+        };
+        std::vector<PastOwner> pastOwners;  ///< exited threads whose events are still in the buffer, guarded by m_registryLock
+        ThreadBuffer(size_t capacity, int index) : events(capacity), count(0), session(0), dropped(0), threadIndex(index),
+                                                   ownerBegin(0), inUse(true){}
+    };
+
+    /// per thread handle of its buffer, gives the buffer back to the tracer when the thread exits
+    struct ThreadSlot{
+        ThreadBuffer *buf = nullptr;
+        uint32_t deniedSession = UINT32_MAX;  ///< session in which no buffer was left for this thread
+        ~ThreadSlot(){
+            if(buf != nullptr)
+                PipelineTracer::instance().releaseBuffer(buf);
+        }
+    };
+
+    std::atomic<bool> m_enabled;
+    std::atomic<uint32_t> m_session;
+    std::atomic<int64_t> m_windowEndUs;
+    std::atomic<uint32_t> m_unbuffered;   ///< events dropped because their thread got no buffer
+    size_t m_capacity;
+    size_t m_maxThreads;
+    int m_nextIndex;
+    std::chrono::steady_clock::time_point m_epoch;
+
+    std::mutex m_registryLock;
+    std::vector<std::shared_ptr<ThreadBuffer> > m_buffers;
+
+    PipelineTracer(void) : m_enabled(false), m_session(0), m_windowEndUs(0), m_unbuffered(0), m_capacity(16384),
+                           m_maxThreads(64), m_nextIndex(0), m_epoch(std::chrono::steady_clock::now()){}
+    PipelineTracer(const PipelineTracer&) = delete;
+    PipelineTracer& operator=(const PipelineTracer&) = delete;
+
+public:
+    /**
+      * @fn instance
+      * @brief get the process wide tracer
+      * @details
+      * @param[in] None
+      * @param[out] None
+      * @return tracer object
+      * @note
+      * @code
+      *     PipelineTracer &tracer = PipelineTracer::instance();
+      * @endcode
+      */
+    static PipelineTracer& instance(void){
+        static PipelineTracer tracer;
+        return tracer;
+    }
+    /**
+      * @fn stageName
+      * @brief get trace event name of a predefined pipeline stage
+      * @param[in] stage pipeline stage
+      * @param[out] None
+      * @return stage name
+      */
+    static const char* stageName(TraceStage stage){
+        static const char *names[TRACE_STAGE_NUM] = {
+            "capture", "decode", "rectify", "disparity", "depth", "point_cloud", "encode", "shm_publish"
+        };
+        return (stage >= 0 && stage < TRACE_STAGE_NUM) ? names[stage] : "unknown";
+    }
+    /**
+      * @fn setCapacity
+      * @brief set event buffer capacity of every thread
+      * @details memory used by tracing is bounded by (maxThreads x capacity x sizeof(TraceEventType)),
+      * about 32 MB with the defaults
+      * @param[in] eventsPerThread event number, default 16384
+      * @param[out] None
+      * @return None
+      * @attention only threads registered after this call use the new capacity, call it before start()
+      */
+    void setCapacity(size_t eventsPerThread){
+        std::lock_guard<std::mutex> lock(m_registryLock);
+        m_capacity = eventsPerThread > 0 ? eventsPerThread : 1;
+    }
+    /**
+      * @fn setMaxThreads
+      * @brief set the number of event buffers, which is the number of threads traced at the same time
+      * @details buffers of exited threads are reused, events of threads without a buffer are dropped and counted
+      * @param[in] threads buffer number, default 64
+      * @param[out] None
+      * @return None
+      * @attention buffers which already exist are kept, call it before start()
+      */
+    void setMaxThreads(size_t threads){
+        std::lock_guard<std::mutex> lock(m_registryLock);
+        m_maxThreads = threads > 0 ? threads : 1;
+    }
+    /**
+      * @fn setThreadName
+      * @brief name the calling thread in the trace timeline
+      * @param[in] name thread name, for example: "capture worker"
+      * @param[out] None
+      * @return None
+      */
+    void setThreadName(const std::string &name){
+        ThreadBuffer *buf = localBuffer();
+        if(buf == nullptr)
+            return;
+        std::lock_guard<std::mutex> lock(m_registryLock);
+        buf->threadName = name;
+    }
+    /**
+      * @fn start
+      * @brief start recording a new trace window
+      * @details events recorded in the previous window are discarded
+      * @param[in] window recording window length, events ending after the window are ignored
+      * @param[out] None
+      * @return None
+      * @code
+      *     PipelineTracer::instance().start(std::chrono::seconds(10));
+      * @endcode
+      */
+    void start(std::chrono::milliseconds window = std::chrono::milliseconds(10000)){
+        m_windowEndUs.store(nowUs() + window.count() * 1000, std::memory_order_relaxed);
+        m_unbuffered.store(0, std::memory_order_relaxed);
+        m_session.fetch_add(1, std::memory_order_release);
+        m_enabled.store(true, std::memory_order_release);
+    }
+    /**
+      * @fn stop
+      * @brief stop recording, recorded events are kept until next start()
+      * @param[in] None
+      * @param[out] None
+      * @return None
+      */
+    void stop(void){
+        m_enabled.store(false, std::memory_order_release);
+    }
+    /**
+      * @fn isEnabled
+      * @brief get tracing status
+      * @param[in] None
+      * @param[out] None
+      * @return true if tracing is started and not stopped
+      */
+    bool isEnabled(void) const{
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+    /**
+      * @fn windowElapsed
+      * @brief tell whether the recording window of current trace is over
+      * @param[in] None
+      * @param[out] None
+      * @return true if tracing is enabled and its window is over
+      * @note caller usually stop() and flush() the trace when it returns true
+      */
+    bool windowElapsed(void) const{
+        return isEnabled() && nowUs() > m_windowEndUs.load(std::memory_order_relaxed);
+    }
+    /**
+      * @fn nowUs
+      * @brief get trace clock time
+      * @param[in] None
+      * @param[out] None
+      * @return time since tracer creation, unit is microseconds
+      */
+    int64_t nowUs(void) const{
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+    }
+    /**
+      * @fn record
+      * @brief record a stage event of calling thread
+      * @details wait free, it returns immediately when tracing is disabled or the event is out of window
+      * @param[in] name stage name, must be a string with static storage duration
+      * @param[in] frameId frame sequence
+      * @param[in] beginUs stage begin time, get by nowUs()
+      * @param[in] endUs stage end time, get by nowUs()
+      * @param[out] None
+      * @return None
+      */
+    void record(const char *name, uint64_t frameId, int64_t beginUs, int64_t endUs){
+        if(!m_enabled.load(std::memory_order_acquire))
+            return;
+        if(endUs > m_windowEndUs.load(std::memory_order_relaxed))
+            return;
+
+        ThreadBuffer *buf = localBuffer();
+        if(buf == nullptr){
+            m_unbuffered.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        uint32_t session = m_session.load(std::memory_order_acquire);
+        if(buf->session.load(std::memory_order_relaxed) != session){
+            buf->count.store(0, std::memory_order_relaxed);
+            buf->dropped.store(0, std::memory_order_relaxed);
+            buf->ownerBegin.store(0, std::memory_order_relaxed);
+            buf->session.store(session, std::memory_order_release);
+        }
+
+        uint32_t n = buf->count.load(std::memory_order_relaxed);
+        if(n >= buf->events.size()){
+            buf->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        TraceEventType &ev = buf->events[n];
+        ev.name = name;
+        ev.frameId = frameId;
+        ev.beginUs = beginUs;
+        ev.durationUs = endUs - beginUs;
+        buf->count.store(n + 1, std::memory_order_release);
+    }
+    /**
+      * @fn flush
+      * @brief write events of current trace window to a Chrome trace-event JSON file
+      * @details it is safe to call while other threads are still recording
+      * @param[in] fileName output file name, for example: "trace.json"
+      * @param[out] None
+      * @return true or false, if write file successfully return true, otherwise return false
+      * @code
+      *     tracer.stop();
+      *     tracer.flush("trace.json");
+      * @endcode
+      */
+    bool flush(const std::string &fileName){
+        FILE *fp = fopen(fileName.c_str(), "w");
+        if(fp == nullptr)
+            return false;
+
+        uint32_t session = m_session.load(std::memory_order_acquire);
+        uint64_t dropped = m_unbuffered.load(std::memory_order_relaxed);
+        bool first = true;
+        fprintf(fp, "{\"traceEvents\":[\n");
+
+        std::lock_guard<std::mutex> lock(m_registryLock);
+        for(size_t i = 0; i < m_buffers.size(); i++){
+            ThreadBuffer *buf = m_buffers[i].get();
+            std::string threadName = buf->threadName.empty() ? "thread " + std::to_string(buf->threadIndex) : buf->threadName;
+            fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", buf->threadIndex, escape(threadName).c_str());
+            first = false;
+
+            if(buf->session.load(std::memory_order_acquire) != session)
+                continue;
+            uint32_t n = buf->count.load(std::memory_order_acquire);
+            for(size_t j = 0; j < buf->pastOwners.size(); j++){
+                const ThreadBuffer::PastOwner &owner = buf->pastOwners[j];
+                if(owner.session != session)
+                    continue;
+                std::string ownerName = owner.threadName.empty() ? "thread " + std::to_string(owner.threadIndex) : owner.threadName;
+                fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                        owner.threadIndex, escape(ownerName).c_str());
+                writeEvents(fp, buf, owner.begin, std::min(owner.end, n), owner.threadIndex);
+            }
+            writeEvents(fp, buf, std::min(buf->ownerBegin.load(std::memory_order_relaxed), n), n, buf->threadIndex);
+            dropped += buf->dropped.load(std::memory_order_relaxed);
+        }
+        fprintf(fp, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":%llu}}\n", (unsigned long long)dropped);
+        return fclose(fp) == 0;
+    }
+
+private:
+    /// buffer of the calling thread: one released by an exited thread that still has room (the new owner
+    /// appends to the events left in it), or a new one while there are less than m_maxThreads;
+    /// nullptr if neither, then retried in the next session only
+    ThreadBuffer* localBuffer(void){
+        static thread_local ThreadSlot slot;
+        if(slot.buf != nullptr)
+            return slot.buf;
+        uint32_t session = m_session.load(std::memory_order_acquire);
+        if(slot.deniedSession == session)
+            return nullptr;
+
+        std::lock_guard<std::mutex> lock(m_registryLock);
+        for(size_t i = 0; i < m_buffers.size() && slot.buf == nullptr; i++){
+            ThreadBuffer *buf = m_buffers[i].get();
+            bool current = buf->session.load(std::memory_order_relaxed) == session;
+            uint32_t n = buf->count.load(std::memory_order_relaxed);
+            if(buf->inUse || (current && n >= buf->events.size()))
+                continue;
+            std::vector<ThreadBuffer::PastOwner> &owners = buf->pastOwners;
+            size_t kept = 0;
+            for(size_t j = 0; j < owners.size(); j++){
+                if(owners[j].session == session)
+                    owners[kept++] = owners[j];
+            }
+            owners.resize(kept);
+            uint32_t begin = buf->ownerBegin.load(std::memory_order_relaxed);
+            if(current && n > begin){
+                ThreadBuffer::PastOwner owner = {session, begin, n, buf->threadIndex, buf->threadName};
+                owners.push_back(owner);
+            }
+            buf->ownerBegin.store(current ? n : 0, std::memory_order_relaxed);
+            buf->threadIndex = ++m_nextIndex;
+            buf->threadName.clear();
+            buf->inUse = true;
+            slot.buf = buf;
+        }
+        if(slot.buf == nullptr && m_buffers.size() < m_maxThreads){
+            m_buffers.push_back(std::make_shared<ThreadBuffer>(m_capacity, ++m_nextIndex));
+            slot.buf = m_buffers.back().get();
+        }
+        if(slot.buf == nullptr)
+            slot.deniedSession = session;
+        return slot.buf;
+    }
+
+    void releaseBuffer(ThreadBuffer *buf){
+        std::lock_guard<std::mutex> lock(m_registryLock);
+        buf->inUse = false;
+    }
+
+    static void writeEvents(FILE *fp, const ThreadBuffer *buf, uint32_t begin, uint32_t end, int threadIndex){
+        for(uint32_t k = begin; k < end; k++){
+            const TraceEventType &ev = buf->events[k];
+            fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"pipeline\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                    "\"ts\":%lld,\"dur\":%lld,\"args\":{\"frame\":%llu}}",
+                    ev.name, threadIndex, (long long)ev.beginUs, (long long)ev.durationUs,
+                    (unsigned long long)ev.frameId);
+        }
+    }
+
+    static std::string escape(const std::string &str){
+        std::string out;
+        for(size_t i = 0; i < str.size(); i++){
+            if(str[i] == '"' || str[i] == '\\')
+                out.push_back('\\');
+            if((unsigned char)str[i] >= 0x20)
+                out.push_back(str[i]);
+        }
+        return out;
+    }
+};
+
+/**
+  * @class TraceScope
+  * @brief record a stage event from construction to destruction
+  * @code
+  *     {
+  *         TraceScope scope(TRACE_ENCODE, frameId);
+  *         cv::imencode(".jpg", left, buf, param);
+  *     }
+  * @endcode
+  */
+class TraceScope
+{
+private:
+    const char *m_name;
+    uint64_t m_frameId;
+    int64_t m_beginUs;
+
+public:
+    TraceScope(const char *name, uint64_t frameId) : m_name(name), m_frameId(frameId),
+        m_beginUs(PipelineTracer::instance().isEnabled() ? PipelineTracer::instance().nowUs() : -1){}
+    TraceScope(TraceStage stage, uint64_t frameId) : TraceScope(PipelineTracer::stageName(stage), frameId){}
+    ~TraceScope(){
+        if(m_beginUs >= 0){
+            PipelineTracer &tracer = PipelineTracer::instance();
+            tracer.record(m_name, m_frameId, m_beginUs, tracer.nowUs());
+        }
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#define PIPELINE_TRACE_CONCAT_(a, b) a##b
+#define PIPELINE_TRACE_CONCAT(a, b) PIPELINE_TRACE_CONCAT_(a, b)
+
+#ifdef UNITREE_DISABLE_TRACE
+#define PIPELINE_TRACE_SCOPE(stage, frameId) do{}while(0)
+#else
+#define PIPELINE_TRACE_SCOPE(stage, frameId) TraceScope PIPELINE_TRACE_CONCAT(__traceScope, __LINE__)(stage, frameId)
+#endif
+
+#endif //__PIPELINE_TRACE_HPP__
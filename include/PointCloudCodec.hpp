@@ -0,0 +1,459 @@
+/**
+  * @file PointCloudCodec.hpp
+  * @brief This file is part of UnitreeCameraSDK, which declare the point cloud codec.
+  * @details Compact transport encoding of SDK point clouds (std::vector<cv::Vec3f> and std::vector<PCLType>).
+  * Coordinates are quantized with a configurable precision bound (1 mm steps by default), delta coded against the
+  * point above for organized clouds or the previous point otherwise, zigzag mapped and bit packed in blocks of 128
+  * values, colors likewise without quantization. An optional zstd pass (HAVE_ZSTD) compresses the packed blocks.
+  * Decoding unpacks the blocks, then undoes zigzag, delta and quantization with OpenCV universal intrinsics
+  * (NEON on arm64, SSE on amd64).
+  * @date  2026.10.19
+  * @version 1.1.0
+  * @copyright Copyright (c)2020-2021, Hangzhou Yushu Technology Stock CO.LTD. All Rights Reserved.
+  */
+
+#ifndef __POINT_CLOUD_CODEC_HPP__
+#define __POINT_CLOUD_CODEC_HPP__
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <opencv2/core/hal/intrin.hpp>
+#include "StereoCameraCommon.hpp"
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/**
+  * @class PointCloudCodec
+  * @brief encoder and decoder of point clouds
+  * @details one object keeps its scratch buffers between frames, use one object per thread.
+  * NaN coordinates are encoded as 0.
+  */
+class PointCloudCodec
+{
+private:
+#pragma pack(push, 1)
+    typedef struct Header{
+        uint32_t magic;      ///< "UPCC"
+        uint8_t version;
+        uint8_t flags;       ///< FLAG_* bits
+        uint8_t channels;    ///< 3 for x, y, z, 6 with b, g, r
+        uint8_t reserved;
+        float step;          ///< quantization step, metres
+        uint32_t count;      ///< number of points
+        uint32_t width;      ///< row length of an organized cloud, 0 if unorganized
+        uint32_t bodySize;   ///< size of the packed blocks before zstd
+    }HeaderType;
+#pragma pack(pop)
+
+    static const uint32_t Magic = 0x43435055;
+    static const uint8_t Version = 1;
+    static const uint8_t FLAG_ORGANIZED = 1;
+    static const uint8_t FLAG_ZSTD = 2;
+    static const int BlockSize = 128;     ///< values per bit width
+    static const int Padding = 8;         ///< trailing bytes, the unpacker reads 64 bits at a time
+    static constexpr float QuantLimit = 536870911.0f;  ///< |quantized value| < 2^29, deltas never overflow
+
+    float m_step;                         ///< quantization step, metres
+    int m_zstdLevel = 0;                  ///< 0 disable zstd
+    std::vector<int32_t> m_values;        ///< channel values, channel after channel
+    std::vector<float> m_coords;          ///< decoded coordinates, channel after channel
+    std::vector<uint8_t> m_body;          ///< packed blocks when zstd is used
+
+    static uint32_t zigzag(int32_t v){
+        return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+    }
+
+    static int32_t quantize(float v, float inverseStep){
+        if(v != v)
+            return 0;
+        float q = v * inverseStep;
+        if(q > QuantLimit) q = QuantLimit;
+        if(q < -QuantLimit) q = -QuantLimit;
+        return (int32_t)cvRound(q);
+    }
+
+#if CV_SIMD128
+    static cv::v_int32x4 quantize(const cv::v_float32x4 &v, const cv::v_float32x4 &inverseStep){
+        cv::v_float32x4 q = cv::v_select(v == v, v * inverseStep, cv::v_setzero_f32());
+        q = cv::v_max(cv::v_min(q, cv::v_setall_f32(QuantLimit)), cv::v_setall_f32(-QuantLimit));
+        return cv::v_round(q);
+    }
+#endif
+
+    /// z = zigzag(v - ref) for n values, return bitwise or of z
+    static uint32_t deltaZigzag(const int32_t *v, const int32_t *ref, uint32_t n, uint32_t *z){
+        uint32_t i = 0, bits = 0;
+#if CV_SIMD128
+        cv::v_uint32x4 acc = cv::v_setzero_u32();
+        for(; i + 4 <= n; i += 4){
+            cv::v_int32x4 d = cv::v_load(v + i) - cv::v_load(ref + i);
+            cv::v_uint32x4 u = cv::v_reinterpret_as_u32(cv::v_shl<1>(d) ^ cv::v_shr<31>(d));
+            cv::v_store(z + i, u);
+            acc = acc | u;
+        }
+        uint32_t lanes[4];
+        cv::v_store(lanes, acc);
+        bits = lanes[0] | lanes[1] | lanes[2] | lanes[3];
+#endif
+        for(; i < n; i++){
+            z[i] = zigzag(v[i] - ref[i]);
+            bits |= z[i];
+        }
+        return bits;
+    }
+
+    /// append one channel as delta coded, zigzag mapped, bit packed blocks at out, return end of written data
+    /// @details values are delta coded against the value above (organized clouds) or the previous value
+    /// @note packed words are stored little endian (amd64 and arm64)
+    static uint8_t* packChannel(const int32_t *v, uint32_t count, uint32_t width, uint8_t *out){
+        uint32_t z[BlockSize];
+        uint32_t rowEnd = width > 0 && width < count ? width : count;
+        for(uint32_t start = 0; start < count; start += BlockSize){
+            uint32_t n = count - start < (uint32_t)BlockSize ? count - start : BlockSize;
+            uint32_t maxValue = 0;
+            uint32_t i = 0;
+            if(start == 0){
+                z[0] = zigzag(v[0]);
+                maxValue = z[0];
+                i = 1;
+            }
+            uint32_t split = rowEnd > start ? (rowEnd - start < n ? rowEnd - start : n) : 0; ///< end of first row
+            if(i < split){
+                maxValue |= deltaZigzag(v + start + i, v + start + i - 1, split - i, z + i);
+                i = split;
+            }
+            if(i < n)
+                maxValue |= deltaZigzag(v + start + i, v + start + i - width, n - i, z + i);
+            int bits = 0;
+            while(bits < 32 && (maxValue >> bits) != 0)
+                bits++;
+            *out++ = (uint8_t)bits;
+            uint64_t acc = 0;
+            int filled = 0;
+            for(i = 0; bits > 0 && i < n; i++){
+                acc |= (uint64_t)z[i] << filled;
+                filled += bits;
+                if(filled >= 32){
+                    uint32_t word = (uint32_t)acc;
+                    memcpy(out, &word, sizeof(word));
+                    out += sizeof(word);
+                    acc >>= 32;
+                    filled -= 32;
+                }
+            }
+            for(; filled > 0; filled -= 8){
+                *out++ = (uint8_t)acc;
+                acc >>= 8;
+            }
+        }
+        return out;
+    }
+
+    /// unpack one channel of zigzag values from [in, end), return end of read data or NULL if corrupted
+    static const uint8_t* unpackChannel(const uint8_t *in, const uint8_t *end, uint32_t count, int32_t *v){
+        for(uint32_t start = 0; start < count; start += BlockSize){
+            uint32_t n = count - start < (uint32_t)BlockSize ? count - start : BlockSize;
+            if(in >= end)
+                return NULL;
+            int bits = *in++;
+            if(bits > 32)
+                return NULL;
+            size_t bytes = ((size_t)n * bits + 7) / 8;
+            if((size_t)(end - in) < bytes)
+                return NULL;
+            uint64_t mask = bits == 32 ? 0xffffffffULL : ((1ULL << bits) - 1);
+            for(uint32_t i = 0; i < n; i++){
+                uint64_t bit = (uint64_t)i * bits;
+                uint64_t word;
+                memcpy(&word, in + (bit >> 3), sizeof(word));
+                v[start + i] = (int32_t)((word >> (bit & 7)) & mask);
+            }
+            in += bytes;
+        }
+        return in;
+    }
+
+    /// undo zigzag and delta coding of one channel
+    static void restoreChannel(int32_t *v, uint32_t count, uint32_t width){
+        if(count == 0)
+            return;
+        uint32_t i = 0;
+        uint32_t rowEnd = width > 0 && width < count ? width : count;
+#if CV_SIMD128
+        cv::v_int32x4 one = cv::v_setall_s32(1), zero = cv::v_setzero_s32();
+        for(; i + 4 <= count; i += 4){
+            cv::v_int32x4 u = cv::v_load(v + i);
+            u = cv::v_reinterpret_as_s32(cv::v_shr<1>(cv::v_reinterpret_as_u32(u))) ^ (zero - (u & one));
+            cv::v_store(v + i, u);
+        }
+#endif
+        for(; i < count; i++){
+            uint32_t u = (uint32_t)v[i];
+            v[i] = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+        }
+
+        /// sequential prefix sum over the first row (the whole cloud if unorganized)
+        i = 1;
+#if CV_SIMD128
+        int32_t carry = v[0];
+        for(; i + 4 <= rowEnd; i += 4){
+            cv::v_int32x4 x = cv::v_load(v + i);
+            x = x + cv::v_rotate_left<1>(x);
+            x = x + cv::v_rotate_left<2>(x);
+            x = x + cv::v_setall_s32(carry);
+            cv::v_store(v + i, x);
+            carry = v[i + 3];
+        }
+#endif
+        for(; i < rowEnd; i++)
+            v[i] += v[i - 1];
+
+        /// every further row adds the row above
+        i = rowEnd;
+#if CV_SIMD128
+        for(; width >= 4 && i + 4 <= count; i += 4)
+            cv::v_store(v + i, cv::v_load(v + i) + cv::v_load(v + i - width));
+#endif
+        for(; i < count; i++)
+            v[i] += v[i - width];
+    }
+
+    /// dequantize one coordinate channel
+    static void dequantize(const int32_t *v, uint32_t count, float step, float *out){
+        uint32_t i = 0;
+#if CV_SIMD128
+        cv::v_float32x4 s = cv::v_setall_f32(step);
+        for(; i + 4 <= count; i += 4)
+            cv::v_store(out + i, cv::v_cvt_f32(cv::v_load(v + i)) * s);
+#endif
+        for(; i < count; i++)
+            out[i] = v[i] * step;
+    }
+
+    bool encodeValues(uint32_t count, int channels, uint32_t width, std::vector<uint8_t> &out){
+        HeaderType header;
+        header.magic = Magic;
+        header.version = Version;
+        header.flags = width > 0 ? FLAG_ORGANIZED : 0;
+        header.channels = (uint8_t)channels;
+        header.reserved = 0;
+        header.step = m_step;
+        header.count = count;
+        header.width = width;
+
+        size_t blocks = (count + BlockSize - 1) / BlockSize;
+        size_t bound = channels * (blocks + (size_t)count * 4) + Padding;
+        bool zstd = false;
+#ifdef HAVE_ZSTD
+        zstd = m_zstdLevel > 0;
+#endif
+        std::vector<uint8_t> &body = zstd ? m_body : out;
+        size_t offset = zstd ? 0 : sizeof(HeaderType);
+        body.resize(offset + bound);
+        uint8_t *p = body.data() + offset;
+        for(int c = 0; c < channels; c++)
+            p = packChannel(m_values.data() + (size_t)c * count, count, width, p);
+        memset(p, 0, Padding);
+        p += Padding;
+        header.bodySize = (uint32_t)(p - (body.data() + offset));
+        body.resize(p - body.data());
+
+#ifdef HAVE_ZSTD
+        if(zstd){
+            out.resize(sizeof(HeaderType) + ZSTD_compressBound(body.size()));
+            size_t size = ZSTD_compress(out.data() + sizeof(HeaderType), out.size() - sizeof(HeaderType),
+                                        body.data(), body.size(), m_zstdLevel);
+            if(ZSTD_isError(size))
+                return false;
+            out.resize(sizeof(HeaderType) + size);
+            header.flags |= FLAG_ZSTD;
+        }
+#endif
+        memcpy(out.data(), &header, sizeof(HeaderType));
+        return true;
+    }
+
+    bool decodeValues(const uint8_t *data, size_t size, HeaderType &header){
+        if(size < sizeof(HeaderType))
+            return false;
+        memcpy(&header, data, sizeof(HeaderType));
+        if(header.magic != Magic || header.version != Version || (header.channels != 3 && header.channels != 6))
+            return false;
+        if(!(header.flags & FLAG_ORGANIZED))
+            header.width = 0;
+
+        const uint8_t *body = data + sizeof(HeaderType);
+        size_t bodySize = size - sizeof(HeaderType);
+        if(header.flags & FLAG_ZSTD){
+#ifdef HAVE_ZSTD
+            if(ZSTD_getFrameContentSize(body, bodySize) != header.bodySize) ///< ZSTD_compress() always stores the size
+                return false;
+            m_body.resize(header.bodySize);
+            size_t n = ZSTD_decompress(m_body.data(), m_body.size(), body, bodySize);
+            if(ZSTD_isError(n) || n != header.bodySize)
+                return false;
+            body = m_body.data();
+            bodySize = n;
+#else
+            return false;
+#endif
+        }
+        if(bodySize < (size_t)Padding)
+            return false;
+
+        uint32_t count = header.count;
+        size_t blocks = ((size_t)count + BlockSize - 1) / BlockSize;
+        if(blocks * header.channels > bodySize - Padding) ///< every block has at least its bit width byte
+            return false;
+        m_values.resize((size_t)count * header.channels);
+        const uint8_t *p = body, *end = body + bodySize - Padding;
+        for(int c = 0; c < header.channels; c++){
+            int32_t *v = m_values.data() + (size_t)c * count;
+            p = unpackChannel(p, end, count, v);
+            if(p == NULL)
+                return false;
+            restoreChannel(v, count, header.width);
+        }
+        m_coords.resize((size_t)count * 3);
+        for(int c = 0; c < 3; c++)
+            dequantize(m_values.data() + (size_t)c * count, count, header.step, m_coords.data() + (size_t)c * count);
+        return true;
+    }
+
+public:
+    /**
+      * @fn PointCloudCodec
+      * @brief constructor
+      * @param[in] precision maximum coordinate error in metres, default 0.0005 (1 mm quantization steps)
+      */
+    PointCloudCodec(float precision = 0.0005f) : m_step(2.0f * precision){}
+
+    /**
+      * @fn setPrecision
+      * @brief set the maximum coordinate error of encoding
+      * @param[in] precision maximum error in metres, quantization step is twice as large
+      */
+    void setPrecision(float precision){
+        m_step = 2.0f * precision;
+    }
+    float getPrecision(void) const{
+        return m_step / 2.0f;
+    }
+    /**
+      * @fn setCompressionLevel
+      * @brief set zstd level of the packed blocks
+      * @param[in] level 0 disable, 1 fastest ... 19 smallest, ignored without HAVE_ZSTD
+      */
+    void setCompressionLevel(int level){
+        m_zstdLevel = level;
+    }
+
+    /**
+      * @fn encode
+      * @brief encode a point cloud
+      * @param[in] pcl point cloud, which element has 3D coordinates information (x, y, z)
+      * @param[out] out encoded point cloud
+      * @param[in] width row length if the cloud is organized (one point per pixel), 0 otherwise
+      * @return true or false, if encoding failed return false
+      * @code
+      *     PointCloudCodec codec;
+      *     std::vector<uint8_t> data;
+      *     if(cam.getPointCloud(pcl, timeStamp) && codec.encode(pcl, data)){
+      *         //send data
+      *     }
+      * @endcode
+      */
+    bool encode(const std::vector<cv::Vec3f> &pcl, std::vector<uint8_t> &out, uint32_t width = 0){
+        uint32_t count = (uint32_t)pcl.size();
+        if(width > 0 && count % width != 0)
+            return false;
+        m_values.resize((size_t)count * 3);
+        int32_t *x = m_values.data(), *y = x + count, *z = y + count;
+        float inverseStep = 1.0f / m_step;
+        uint32_t i = 0;
+#if CV_SIMD128
+        const float *in = count > 0 ? &pcl[0][0] : NULL;
+        cv::v_float32x4 inv = cv::v_setall_f32(inverseStep);
+        for(; i + 4 <= count; i += 4){
+            cv::v_float32x4 px, py, pz;
+            cv::v_load_deinterleave(in + i * 3, px, py, pz);
+            cv::v_store(x + i, quantize(px, inv));
+            cv::v_store(y + i, quantize(py, inv));
+            cv::v_store(z + i, quantize(pz, inv));
+        }
+#endif
+        for(; i < count; i++){
+            x[i] = quantize(pcl[i][0], inverseStep);
+            y[i] = quantize(pcl[i][1], inverseStep);
+            z[i] = quantize(pcl[i][2], inverseStep);
+        }
+        return encodeValues(count, 3, width, out);
+    }
+    /**
+      * @overload
+      * @brief encode a point cloud with color, colors are lossless
+      */
+    bool encode(const std::vector<PCLType> &pcl, std::vector<uint8_t> &out, uint32_t width = 0){
+        uint32_t count = (uint32_t)pcl.size();
+        if(width > 0 && count % width != 0)
+            return false;
+        m_values.resize((size_t)count * 6);
+        float inverseStep = 1.0f / m_step;
+        for(uint32_t i = 0; i < count; i++){
+            for(int c = 0; c < 3; c++){
+                m_values[(size_t)c * count + i] = quantize(pcl[i].pts[c], inverseStep);
+                m_values[(size_t)(c + 3) * count + i] = pcl[i].clr[c];
+            }
+        }
+        return encodeValues(count, 6, width, out);
+    }
+
+    /**
+      * @fn decode
+      * @brief decode a point cloud
+      * @param[in] data encoded point cloud
+      * @param[in] size size of data
+      * @param[out] pcl point cloud, colors are dropped if encoded
+      * @return true or false, if data is not a valid encoded point cloud return false
+      */
+    bool decode(const uint8_t *data, size_t size, std::vector<cv::Vec3f> &pcl){
+        HeaderType header;
+        if(!decodeValues(data, size, header))
+            return false;
+        uint32_t count = header.count;
+        pcl.resize(count);
+        const float *x = m_coords.data(), *y = x + count, *z = y + count;
+        uint32_t i = 0;
+#if CV_SIMD128
+        float *out = count > 0 ? &pcl[0][0] : NULL;
+        for(; i + 4 <= count; i += 4)
+            cv::v_store_interleave(out + i * 3, cv::v_load(x + i), cv::v_load(y + i), cv::v_load(z + i));
+#endif
+        for(; i < count; i++)
+            pcl[i] = cv::Vec3f(x[i], y[i], z[i]);
+        return true;
+    }
+    /**
+      * @overload
+      * @brief decode a point cloud with color, colors are black if not encoded
+      */
+    bool decode(const uint8_t *data, size_t size, std::vector<PCLType> &pcl){
+        HeaderType header;
+        if(!decodeValues(data, size, header))
+            return false;
+        uint32_t count = header.count;
+        pcl.resize(count);
+        const float *x = m_coords.data(), *y = x + count, *z = y + count;
+        const int32_t *b = m_values.data() + (size_t)3 * count, *g = b + count, *r = g + count;
+        bool color = header.channels == 6;
+        for(uint32_t i = 0; i < count; i++){
+            pcl[i].pts = cv::Vec3f(x[i], y[i], z[i]);
+            pcl[i].clr = color ? cv::Vec3b((uint8_t)b[i], (uint8_t)g[i], (uint8_t)r[i]) : cv::Vec3b(0, 0, 0);
+        }
+        return true;
+    }
+};
+
+#endif //__POINT_CLOUD_CODEC_HPP__
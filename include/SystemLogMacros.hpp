@@ -0,0 +1,241 @@
+/**
+  * @file SystemLogMacros.hpp
+  * @brief This file is part of UnitreeCameraSDK, which declare the log front-ends of SystemLog.
+  * @details The macros check a build-time threshold and a per-module runtime level before the log call,
+  * so filtered messages never evaluate their arguments and never reach the printf-style formatting.
+  * They work with both SystemLog and AsyncSystemLog. Hot-path warnings can be rate limited (token bucket) and
+  * identical repeats folded into "last message repeated N times", with lock-free state per call site.
+  * @date  2026.10.19
+  * @version 1.1.0
+  * @copyright Copyright (c)2020-2021, Hangzhou Yushu Technology Stock CO.LTD. All Rights Reserved.
+  */
+
+#ifndef __SYSTEMLOG_MACROS_HPP__
+#define __SYSTEMLOG_MACROS_HPP__
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <type_traits>
+#include "SystemLog.hpp"
+
+/**
+  * @def UNITREE_LOG_COMPILE_LEVEL
+  * @brief build-time log level, messages above it are compiled out
+  * @details 0 no output, 1 running information output, 2 running and debug infomation output.
+  * set by cmake option UNITREE_LOG_COMPILE_LEVEL, default 2.
+  */
+#ifndef UNITREE_LOG_COMPILE_LEVEL
+#define UNITREE_LOG_COMPILE_LEVEL 2
+#endif
+
+/**
+  * @enum LogModule
+  * @brief modules which own an independent runtime log level
+  * @attention the levels only gate calls made through these macros. The prebuilt libunitree_camera logs
+  * through SystemLog directly, so setLevel(LOG_MODULE_STEREO_CAMERA / LOG_MODULE_UNITREE_CAMERA_SDK, ...)
+  * does not change the SDK's own output; those modules are for application code which tags its camera
+  * related messages with them.
+  */
+enum LogModule {
+    LOG_MODULE_STEREO_CAMERA = 0,    ///< application messages about StereoCamera, not the SDK's own
+    LOG_MODULE_UNITREE_CAMERA_SDK,   ///< application messages about UnitreeCameraSDK, not the SDK's own
+    LOG_MODULE_APPLICATION,          ///< user application
+    LOG_MODULE_NUM
+};
+
+/**
+  * @class LogModuleLevels
+  * @brief runtime log level of every LogModule
+  * @details levels are constant initialized atomics, checking a level is a single relaxed load
+  */
+class LogModuleLevels
+{
+private:
+    static std::atomic<int>* levels(void){
+        static std::atomic<int> moduleLevels[LOG_MODULE_NUM] = { {1}, {1}, {1} };
+        return moduleLevels;
+    }
+
+public:
+    /**
+      * @fn setLevel
+      * @brief set runtime log level of a module
+      * @param[in] module log module
+      * @param[in] level 0 no output, 1 running information output, 2 running and debug infomation output
+      * @code
+      *     LogModuleLevels::setLevel(LOG_MODULE_APPLICATION, 2);
+      * @endcode
+      */
+    static void setLevel(LogModule module, int level){
+        levels()[module].store(level, std::memory_order_relaxed);
+    }
+    /**
+      * @fn getLevel
+      * @brief get runtime log level of a module
+      */
+    static int getLevel(LogModule module){
+        return levels()[module].load(std::memory_order_relaxed);
+    }
+    /**
+      * @fn enabled
+      * @brief tell whether a message of level passes the runtime level of module
+      * @param[in] module log module
+      * @param[in] level 1 running information, 2 debug infomation
+      */
+    static bool enabled(LogModule module, int level){
+        return levels()[module].load(std::memory_order_relaxed) >= level;
+    }
+};
+
+/**
+  * @class LogCallSite
+  * @brief rate limiting and repeat suppression state of one log call site
+  * @details the token bucket is kept as a theoretical arrival time (GCRA), so taking a token is a single
+  * compare-and-swap. The state is constant initialized, a call site which never logs costs nothing.
+  * Folded repeats and rate limited messages are reported before the next output of the call site, or by the
+  * first call after RepeatWindowUs has passed since the last output (flushExpired).
+  * @attention counts are only reported when the call site is reached again: those still pending when a call
+  * site goes quiet for good or the process exits are lost.
+  */
+class LogCallSite
+{
+private:
+    std::atomic<int64_t> m_arrivalUs;     ///< theoretical arrival time of next message
+    std::atomic<uint32_t> m_limited;      ///< messages dropped by token bucket since last output
+    std::atomic<uint32_t> m_repeated;     ///< identical messages folded since last output
+    std::atomic<uint64_t> m_lastHash;     ///< hash of last output message
+    std::atomic<int64_t> m_lastOutputUs;  ///< time of last output message
+
+    static int64_t nowUs(void){
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    template<typename Logger>
+    void report(Logger &logger, void (Logger::*method)(const char*, ...)){
+        uint32_t repeated = m_repeated.exchange(0, std::memory_order_relaxed);
+        uint32_t limited = m_limited.exchange(0, std::memory_order_relaxed);
+        if(repeated > 0)
+            (logger.*method)("last message repeated %u times\n", repeated);
+        if(limited > 0)
+            (logger.*method)("%u messages suppressed by rate limit\n", limited);
+    }
+    static uint64_t hash(const char *text){
+        uint64_t h = 1469598103934665603ULL;
+        for(; *text; text++)
+            h = (h ^ (unsigned char)*text) * 1099511628211ULL;
+        return h;
+    }
+
+public:
+    /// a repeated message is printed again after this window even if nothing else was logged
+    static const int64_t RepeatWindowUs = 5000000;
+
+    constexpr LogCallSite(void) : m_arrivalUs(0), m_limited(0), m_repeated(0), m_lastHash(0), m_lastOutputUs(0){}
+
+    /**
+      * @fn acquire
+      * @brief take a token from the bucket of this call site
+      * @param[in] ratePerSecond token refill rate, messages never pass if it is 0 or negative
+      * @param[in] burst bucket size, at least 1
+      * @return true or false, if a token is taken return true, otherwise the message is counted and return false
+      */
+    bool acquire(double ratePerSecond, int burst){
+        if(!(ratePerSecond > 0)){
+            m_limited.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        int64_t interval = (int64_t)(1000000.0 / ratePerSecond);
+        int64_t tolerance = interval * (burst > 1 ? burst - 1 : 0);
+        int64_t now = nowUs();
+        int64_t arrival = m_arrivalUs.load(std::memory_order_relaxed);
+        while(true){
+            int64_t base = arrival > now ? arrival : now;
+            if(base - now > tolerance){
+                m_limited.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if(m_arrivalUs.compare_exchange_weak(arrival, base + interval, std::memory_order_relaxed))
+                return true;
+        }
+    }
+    /**
+      * @fn emit
+      * @brief format a message and output it through logger.method, unless it repeats the last output
+      * @details before a new message, the number of folded repeats and rate limited messages are reported
+      */
+    template<typename Logger>
+    void emit(Logger &logger, void (Logger::*method)(const char*, ...), const char *format, ...){
+        char text[256];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(text, sizeof(text), format, args);
+        va_end(args);
+
+        uint64_t h = hash(text);
+        int64_t now = nowUs();
+        if(m_lastHash.load(std::memory_order_relaxed) == h &&
+           now - m_lastOutputUs.load(std::memory_order_relaxed) < RepeatWindowUs){
+            m_repeated.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        m_lastHash.store(h, std::memory_order_relaxed);
+        m_lastOutputUs.store(now, std::memory_order_relaxed);
+
+        report(logger, method);
+        (logger.*method)("%s", text);
+    }
+    /**
+      * @fn flushExpired
+      * @brief report pending repeat and rate limit counts if RepeatWindowUs has passed since the last output
+      * @details called for messages which did not get a token, so a call site which keeps being rate limited
+      * still reports what it dropped
+      */
+    template<typename Logger>
+    void flushExpired(Logger &logger, void (Logger::*method)(const char*, ...)){
+        if(m_repeated.load(std::memory_order_relaxed) == 0 && m_limited.load(std::memory_order_relaxed) == 0)
+            return;
+        int64_t now = nowUs();
+        int64_t last = m_lastOutputUs.load(std::memory_order_relaxed);
+        if(now - last < RepeatWindowUs || !m_lastOutputUs.compare_exchange_strong(last, now, std::memory_order_relaxed))
+            return;
+        report(logger, method);
+    }
+};
+
+/// log through logger.method(...) if module level allows messages of level, arguments are not evaluated otherwise
+#define SYSLOG_AT_LEVEL(logger, module, level, method, ...) \
+    do{ \
+        if((level) <= UNITREE_LOG_COMPILE_LEVEL && LogModuleLevels::enabled(module, level)) \
+            (logger).method(__VA_ARGS__); \
+    }while(0)
+
+#define SYSLOG_RUNTIME_ERROR(logger, module, ...)   SYSLOG_AT_LEVEL(logger, module, 1, runTimeError, __VA_ARGS__)
+#define SYSLOG_RUNTIME_INFO(logger, module, ...)    SYSLOG_AT_LEVEL(logger, module, 1, runTimeInfo, __VA_ARGS__)
+#define SYSLOG_RUNTIME_WARNING(logger, module, ...) SYSLOG_AT_LEVEL(logger, module, 1, runTimeWarning, __VA_ARGS__)
+#define SYSLOG_DEBUG_WARNING(logger, module, ...)   SYSLOG_AT_LEVEL(logger, module, 2, debugTimeWarning, __VA_ARGS__)
+#define SYSLOG_DEBUG_INFO(logger, module, ...)      SYSLOG_AT_LEVEL(logger, module, 2, debugTimeInfo, __VA_ARGS__)
+#define SYSLOG_DEBUG_ERROR(logger, module, ...)     SYSLOG_AT_LEVEL(logger, module, 2, debugTimeError, __VA_ARGS__)
+
+/// like SYSLOG_AT_LEVEL, but at most ratePerSecond messages (bursts of burst) pass, identical repeats are folded
+#define SYSLOG_LIMITED_AT_LEVEL(logger, module, level, method, ratePerSecond, burst, ...) \
+    do{ \
+        if((level) <= UNITREE_LOG_COMPILE_LEVEL && LogModuleLevels::enabled(module, level)){ \
+            static LogCallSite __logCallSite; \
+            if(__logCallSite.acquire(ratePerSecond, burst)) \
+                __logCallSite.emit(logger, &std::remove_reference<decltype(logger)>::type::method, __VA_ARGS__); \
+            else \
+                __logCallSite.flushExpired(logger, &std::remove_reference<decltype(logger)>::type::method); \
+        } \
+    }while(0)
+
+#define SYSLOG_RUNTIME_ERROR_LIMITED(logger, module, ratePerSecond, burst, ...) \
+    SYSLOG_LIMITED_AT_LEVEL(logger, module, 1, runTimeError, ratePerSecond, burst, __VA_ARGS__)
+#define SYSLOG_RUNTIME_WARNING_LIMITED(logger, module, ratePerSecond, burst, ...) \
+    SYSLOG_LIMITED_AT_LEVEL(logger, module, 1, runTimeWarning, ratePerSecond, burst, __VA_ARGS__)
+#define SYSLOG_DEBUG_WARNING_LIMITED(logger, module, ratePerSecond, burst, ...) \
+    SYSLOG_LIMITED_AT_LEVEL(logger, module, 2, debugTimeWarning, ratePerSecond, burst, __VA_ARGS__)
+
+#endif //__SYSTEMLOG_MACROS_HPP__